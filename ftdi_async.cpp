@@ -0,0 +1,182 @@
+// Coroutine acquisition on one asio event loop (see include/osci/usbasync.hpp): a
+// writer coroutine queues blocks of scan list frames, a reader coroutine awaits
+// their samples and decodes them, and a reporter coroutine prints the frame rate
+// and the column means once per interval. All three run on the main thread; the
+// writer is held back only by the chip, whose command engine stalls while the
+// samples it produced are still unread.
+// Usage: ftdi_async [--seconds s] [--interval ms] [--scan file] [--serial S]
+
+// Windows:
+//gcc -c include/libftdi/ftdi.c $(pkg-config --cflags libusb-1.0) -o build/ftdi.o -Wall && g++ ftdi_async.cpp build/ftdi.o -I include/ -std=c++20 -fcoroutines $(pkg-config --cflags --libs libusb-1.0) -lws2_32 -lmswsock -pthread -o build/ftdi_async -Wall
+
+// Linux:
+//gcc -c include/libftdi/ftdi.c $(pkg-config --cflags libusb-1.0) -o build/ftdi.o -Wall && g++ ftdi_async.cpp build/ftdi.o -I include/ -std=c++20 -fcoroutines $(pkg-config --cflags --libs libusb-1.0) -pthread -o build/ftdi_async -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/calib.hpp>
+#include <osci/decimate.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <osci/timebase.hpp>
+#include <osci/usbasync.hpp>
+#include <string.h>
+#include <iostream>
+#include <vector>
+
+
+namespace Osci{
+   const unsigned int chunkSize = 0x10000;      // bulk-IN transfer size
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const int32_t blockFrames = 4096;            // frames per write and per read
+}
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+int main(int argc, char *argv[]){
+   double seconds = 10;
+   int interval = 1000; // ms between reports
+   const char* scanPath = NULL;
+   const char* serial = NULL;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--seconds") == 0 && a+1 < argc) seconds = std::stod(argv[++a]);
+      else if(strcmp(argv[a], "--interval") == 0 && a+1 < argc) interval = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+   }
+   if(!(seconds > 0) || interval < 1){
+      std::cout << "The duration and the report interval must be positive\n";
+      exit(1);
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context, serial);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   ftdi_read_data_set_chunksize(&Ft232::context, Osci::chunkSize);
+   ftdi_write_data_set_chunksize(&Ft232::context, Osci::writeChunkSize);
+   ftdi_write_data_set_queue_depth(&Ft232::context, Osci::writeQueueDepth);
+   ftdi_transfer_pool_reserve(&Ft232::context, 2, Osci::writeQueueDepth + 1);
+
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(Osci::boardSerial(&Ft232::context));
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+
+   // Frames end with their CS release, as no DAC write follows them
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::setBitsClocks)){
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout);
+   const int columns = scan.reads();
+   const int32_t blockReadBytes = Osci::blockFrames*columns*Osci::adcReadBytes;
+   const double nsPerFrame = scan.frameClocks()*Osci::skPeriodNs(spi.divisor);
+   const int64_t nBlocks = (int64_t) ceil(seconds*1e9/nsPerFrame/Osci::blockFrames);
+
+   // Setup MPSSE
+   uint8_t setup[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(setup, &iWrite, spi.divisor);
+   if ( ftdi_write_data(&Ft232::context, setup, iWrite) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   std::vector<uint8_t> block((size_t)Osci::blockFrames*(scan.frameBytes() + Osci::releaseCmdBytes));
+   int32_t iRead = 0;
+   iWrite = 0;
+   for(int32_t f = 0; f < Osci::blockFrames; f++){
+      scan.append(block.data(), &iWrite, &iRead);
+      Osci::releaseCs(block.data(), &iWrite);
+   }
+
+   boost::asio::io_context io;
+   Osci::UsbAsync usb(io, &Ft232::context);
+   Osci::TimeBase timeBase;
+   std::vector<double> sum(columns, 0.0);
+   int64_t nRead = 0, nReported = 0; // frames
+   bool done = false, failed = false;
+   ftdi_tcoflush(&Ft232::context);
+
+   // Writer: the next block as soon as the last one is out
+   boost::asio::co_spawn(io, [&]() -> boost::asio::awaitable<void>{
+      for(int64_t b = 0; b < nBlocks && !failed; b++){
+         if(co_await usb.write(block.data(), (int) block.size()) != (int) block.size() && !failed){
+            std::cout << "Write failed at block " << b << '\n';
+            failed = true;
+            usb.cancel(); // the reader waits for samples that won't come
+         }
+      }
+   }, boost::asio::detached);
+
+   // Reader: decode each block while the writer keeps the chip busy
+   boost::asio::co_spawn(io, [&]() -> boost::asio::awaitable<void>{
+      std::vector<uint8_t> readBuf(blockReadBytes);
+      std::vector<uint16_t> adc((size_t)Osci::blockFrames*columns);
+      for(int64_t b = 0; b < nBlocks && !failed; b++){
+         if(co_await usb.read(readBuf.data(), blockReadBytes) != blockReadBytes){
+            if(!failed) std::cout << "Read failed at block " << b << '\n';
+            failed = true;
+            usb.cancel(); // the writer waits on an engine stalled by the unread samples
+            break;
+         }
+         nRead += Osci::blockFrames;
+         timeBase.mark(nRead);
+         Osci::decodeFrames(readBuf.data(), Osci::blockFrames, adc.data(), columns);
+         for(int32_t f = 0; f < Osci::blockFrames; f++){
+            for(int c = 0; c < columns; c++) sum[c] += Osci::adcSigned(adc[(size_t)f*columns + c]);
+         }
+      }
+      done = true;
+   }, boost::asio::detached);
+
+   // Reporter: rate and column means of the frames read since the last report
+   boost::asio::co_spawn(io, [&]() -> boost::asio::awaitable<void>{
+      boost::asio::steady_timer timer(io);
+      while(!done){
+         timer.expires_after(std::chrono::milliseconds(interval));
+         co_await timer.async_wait(boost::asio::use_awaitable);
+         int64_t n = nRead - nReported;
+         if(n == 0) continue;
+         std::cout << (double) n/interval << " kS/s"; // frames per ms
+         for(int c = 0; c < columns; c++){
+            std::cout << ", " << Osci::codeToVolt(sum[c]/n) << " V";
+            sum[c] = 0;
+         }
+         std::cout << '\n';
+         nReported = nRead;
+      }
+   }, boost::asio::detached);
+
+   io.run();
+   if(failed){
+      exit(1);
+   }
+   std::cout << nRead << " frames, " << timeBase.nsPerFrame() << " ns/frame (nominal " << nsPerFrame << "), jitter "
+             << timeBase.jitterNs()/1000.0 << " us over " << timeBase.count() << " reads\n";
+   struct ftdi_line_status_stats lineStatus;
+   ftdi_get_line_status_stats(&Ft232::context, &lineStatus);
+   if(lineStatus.overruns > 0){
+      std::cout << lineStatus.overruns << " FIFO overruns, the first at byte " << lineStatus.overrun_pos[0] << '\n';
+   }
+
+   // Clear system
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return 0;
+}
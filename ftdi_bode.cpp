@@ -0,0 +1,237 @@
+// Frequency response (Bode) sweep: steps the DAC through a list of sine
+// frequencies and measures every ADC column's gain and phase against the
+// stimulus by synchronous demodulation (see include/osci/bode.hpp). Each step
+// runs until the response settles; the device and the buffers are set up once
+// for the whole sweep. Writes bode.csv: frequency, then gain (dB) and phase
+// (degrees) per column.
+// Usage: ftdi_bode [--sweep fmin fmax points] [--freqs file] [--amplitude codes] [--offset codes]
+//                  [--ref column] [--dacfs V] [--scan file] [--serial S]
+
+// Windows:
+//g++ ftdi_bode.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_bode -Wall
+
+// Linux:
+//g++ ftdi_bode.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_bode -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/bode.hpp>
+#include <osci/calib.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+
+namespace Osci{
+   const unsigned int chunkSize = 0x5FFFFFFE;
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const int blocksAhead = 2;                   // blocks queued on the chip, so the stimulus never stops
+   const int32_t readStepFrames = 4096;         // frames per read while a block comes in
+   const double adcSpan = 5.0;                  // ADC volts over 4095 codes (see codeToVolt)
+}
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+int main(int argc, char *argv[]){
+   double fMin = 10, fMax = 0;  // Hz, fMax 0: a quarter of the frame rate
+   int points = 100;
+   const char* freqPath = NULL; // frequency list, one Hz value per line
+   int amplitude = 819;         // DAC codes, 0.2 of full scale like gen.m
+   int offset = 2048;
+   int ref = -1;                // column measured against instead of the stimulus
+   double dacFullScale = Osci::adcSpan; // DAC volts over 4095 codes
+   const char* scanPath = NULL;
+   const char* serial = NULL;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--sweep") == 0 && a+3 < argc){
+         fMin = std::stod(argv[++a]);
+         fMax = std::stod(argv[++a]);
+         points = std::stoi(argv[++a]);
+      }
+      else if(strcmp(argv[a], "--freqs") == 0 && a+1 < argc) freqPath = argv[++a];
+      else if(strcmp(argv[a], "--amplitude") == 0 && a+1 < argc) amplitude = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--offset") == 0 && a+1 < argc) offset = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--ref") == 0 && a+1 < argc) ref = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--dacfs") == 0 && a+1 < argc) dacFullScale = std::stod(argv[++a]);
+      else if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+   }
+   if(amplitude < 1 || offset - amplitude < 0 || offset + amplitude > 0xFFF){
+      std::cout << "The sine must stay within the DAC codes 0..4095\n";
+      exit(1);
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context, serial);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   ftdi_write_data_set_chunksize(&Ft232::context, Osci::writeChunkSize);
+   ftdi_write_data_set_queue_depth(&Ft232::context, Osci::writeQueueDepth);
+   ftdi_transfer_pool_reserve(&Ft232::context, Osci::blocksAhead + 1, Osci::blocksAhead*Osci::writeQueueDepth + 1);
+   ftdi_read_data_set_chunksize(&Ft232::context, Osci::chunkSize);
+
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(Osci::boardSerial(&Ft232::context));
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::dacWriteClocks)){
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout);
+   const int columns = scan.reads();
+   const int32_t sampleReadBytes = columns*Osci::adcReadBytes;
+   if(ref >= columns){
+      std::cout << "Reference column " << ref << " not in the scan list\n";
+      exit(1);
+   }
+
+   // Frequencies in cycles per frame, at the nominal frame rate
+   double fs = 1e9/(scan.frameClocks()*Osci::skPeriodNs(spi.divisor));
+   std::vector<double> freqs;
+   if(freqPath != NULL){
+      if(!Osci::loadFrequencies(freqPath, &freqs)){
+         std::cout << "Can't read frequencies from " << freqPath << '\n';
+         exit(1);
+      }
+   }else{
+      freqs = Osci::logSweep(fMin, fMax > 0 ? fMax : fs/4, points);
+   }
+   std::vector<Osci::BodeStep> steps;
+   int32_t maxFrames = 0;
+   for(double f : freqs){
+      steps.push_back(Osci::bodeStep(f/fs));
+      if(steps.back().frames > maxFrames) maxFrames = steps.back().frames;
+   }
+   std::cout << "sweep: " << steps.size() << " steps at " << fs/1e3 << " kS/s, blocks up to " << maxFrames << " frames\n";
+
+   // Setup MPSSE
+   uint8_t setup[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(setup, &iWrite, spi.divisor);
+   if ( ftdi_write_data(&Ft232::context, setup, iWrite) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   // Buffers for the longest block, reused by every step
+   std::vector<uint8_t> frameCmd(scan.frameBytes());
+   int32_t nCmd = 0, frameReads = 0;
+   scan.append(frameCmd.data(), &nCmd, &frameReads);
+   const struct ftdi_iovec frameFrag = {frameCmd.data(), (int) frameCmd.size()};
+   std::vector<uint16_t> codes(maxFrames);
+   std::vector<uint8_t> dacCmd((size_t)maxFrames*Osci::dacCmdBytes);
+   std::vector<struct ftdi_iovec> block;
+   block.reserve(2*(size_t)maxFrames);
+   std::vector<uint8_t> readBuf((size_t)maxFrames*sampleReadBytes);
+   std::vector<uint16_t> adc((size_t)maxFrames*columns);
+   Osci::Lockin lockin;
+
+   std::ofstream outFile("bode.csv");
+   outFile.precision(6);
+   auto t0 = std::chrono::steady_clock::now();
+   int unsettled = 0;
+   for(const Osci::BodeStep& step : steps){
+      // One block of the step's sine: DAC write then the ADC frame, every frame
+      lockin.start(step, (uint16_t) offset, (uint16_t) amplitude, codes.data());
+      block.clear();
+      iWrite = 0;
+      for(int32_t k = 0; k < step.frames; k++){
+         int32_t at = iWrite;
+         Osci::writeDac(dacCmd.data(), &iWrite, codes[k]);
+         block.push_back({dacCmd.data() + at, iWrite - at});
+         block.push_back(frameFrag);
+      }
+
+      // Keep blocksAhead blocks queued so the stimulus never stops. A block is only
+      // submitted once the one before has all its chunks submitted, so the transfers
+      // of two blocks can't interleave on the endpoint.
+      std::deque<struct ftdi_transfer_control*> queued;
+      bool done = false, failed = false, steady = false;
+      auto topUp = [&]{
+         while(!done && !failed && (int) queued.size() < Osci::blocksAhead
+               && (queued.empty() || queued.back()->submitted >= queued.back()->size)){
+            struct ftdi_transfer_control* tc = ftdi_write_datav_submit(&Ft232::context, block.data(), (int) block.size());
+            if(tc == NULL) failed = true;
+            else queued.push_back(tc);
+         }
+      };
+      topUp();
+
+      // Read, demodulate and decide after each block, reading in pieces to top up meanwhile
+      std::vector<std::complex<double>> h(columns), prev;
+      int32_t blockBytes = step.frames*sampleReadBytes;
+      int32_t readStep = Osci::readStepFrames*sampleReadBytes;
+      int blocks = 0;
+      while(!queued.empty() && !failed){
+         for(int32_t nRead = 0; nRead < blockBytes && !failed;){
+            int32_t n = (blockBytes - nRead < readStep) ? blockBytes - nRead : readStep;
+            if(ftdi_read_data(&Ft232::context, readBuf.data() + nRead, n) != n) failed = true;
+            nRead += n;
+            topUp();
+         }
+         ftdi_transfer_data_done(queued.front());
+         queued.pop_front();
+         if(failed || done) continue; // draining the blocks queued past the settled one
+         blocks++;
+         Osci::decodeFrames(readBuf.data(), step.frames, adc.data(), columns);
+         for(int c = 0; c < columns; c++){
+            h[c] = lockin.response(adc.data(), columns, c, scan.latency(c));
+         }
+         steady = Osci::settled(h, prev);
+         done = steady || blocks >= Osci::bodeMaxBlocks;
+         prev = h;
+         topUp();
+      }
+      if(failed){
+         for(struct ftdi_transfer_control* tc : queued) ftdi_transfer_data_cancel(tc, NULL);
+         std::cout << "Read failed at " << step.freq*fs << " Hz\n";
+         break;
+      }
+      if(!steady) unsettled++;
+
+      outFile << step.freq*fs;
+      std::cout << step.freq*fs << " Hz (" << blocks << " blocks):";
+      for(int c = 0; c < columns; c++){
+         std::complex<double> r = ref >= 0 ? h[c]/h[ref] : h[c]*Osci::adcSpan/dacFullScale;
+         double gainDb = 20*log10(std::abs(r)), phaseDeg = std::arg(r)*180/M_PI;
+         outFile << "; " << gainDb << "; " << phaseDeg;
+         std::cout << ' ' << gainDb << " dB " << phaseDeg << " deg" << (c < columns-1 ? "," : "");
+      }
+      outFile << '\n';
+      std::cout << '\n';
+   }
+   outFile.close();
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   std::cout << "bode.csv: " << steps.size() << " steps in " << secs << " s";
+   if(unsettled > 0) std::cout << ", " << unsettled << " not settled after " << Osci::bodeMaxBlocks << " blocks";
+   std::cout << "\nDone\n";
+
+   // Clear system
+   iWrite = 0;
+   Osci::releaseCs(setup, &iWrite);
+   ftdi_write_data(&Ft232::context, setup, iWrite);
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return 0;
+}
@@ -0,0 +1,171 @@
+// SPI clock calibration: sweeps the TCK divisor and the read edge with a DAC->ADC
+// loopback pattern and keeps the fastest setting whose readings all fall within
+// the spread of a slow reference run. The result is saved per board.
+// Usage: ftdi_calibrate [loopback ADC] [tolerance LSB] [reference divisor]
+
+// Windows:
+//g++ ftdi_calibrate.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_calibrate -Wall
+
+// Linux:
+//g++ ftdi_calibrate.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_calibrate -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/calib.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <iostream>
+#include <vector>
+
+
+namespace Osci{
+   const int calibCodes = 32;   // DAC codes in the pattern, spread over the range
+   const int calibReads = 8;    // ADC reads per code
+   const int calibSettle = 2;   // reads discarded after each DAC write
+   const int calibRuns = 4;     // pattern repetitions per setting
+   const int maxEmptyReads = 1000;
+}
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+// Run the pattern once with the given setting. vals gets calibCodes*calibReads ADC values.
+bool measure(const Osci::SpiSetting& s, int adc, std::vector<uint16_t>* vals){
+   Osci::ScanList scan;
+   Osci::ScanEntry e;
+   e.adc = adc;
+   e.rate = Osci::calibReads;
+   scan.entries.push_back(e);
+   if(!scan.compile(s.readEdge, s.divisor, Osci::dacWriteClocks)){
+      return false;
+   }
+
+   std::vector<uint8_t> writeBuf(Osci::setupCmdBytes + Osci::calibCodes*(Osci::dacCmdBytes + scan.frameBytes()) + Osci::releaseCmdBytes + 1);
+   int32_t iWrite = 0, iRead = 0;
+   Osci::setupMpsse(writeBuf.data(), &iWrite, s.divisor);
+   for(int c = 0; c < Osci::calibCodes; c++){
+      Osci::writeDac(writeBuf.data(), &iWrite, (uint16_t) (c*0x0FFF/(Osci::calibCodes - 1)));
+      scan.append(writeBuf.data(), &iWrite, &iRead);
+   }
+   Osci::releaseCs(writeBuf.data(), &iWrite);
+   writeBuf[iWrite++] = SEND_IMMEDIATE; // opcode: flush the read data to the host now
+
+   if(ftdi_write_data(&Ft232::context, writeBuf.data(), iWrite) != iWrite){
+      return false;
+   }
+   std::vector<uint8_t> readBuf(iRead);
+   int32_t got = 0;
+   int empty = 0;
+   while(got < iRead && empty < Osci::maxEmptyReads){
+      int r = ftdi_read_data(&Ft232::context, readBuf.data() + got, iRead - got);
+      if(r < 0) return false;
+      if(r == 0) empty++;
+      got += r;
+   }
+   if(got != iRead){
+      return false;
+   }
+   vals->resize(iRead/Osci::adcReadBytes);
+   Osci::decodeFrames(readBuf.data(), Osci::calibCodes, vals->data(), Osci::calibReads);
+   return true;
+}
+
+
+int main(int argc, char *argv[]){
+   int adc = 0;            // ADC wired to the DAC output
+   int tolerance = 4;      // LSB allowed outside the reference spread
+   int refDivisor = 29;    // 1 MHz
+   switch (argc)
+   {
+   case 4:
+      refDivisor = (int) std::stoi(argv[3]);
+   case 3:
+      tolerance = (int) std::stoi(argv[2]);
+   case 2:
+      adc = (int) std::stoi(argv[1]);
+      break;
+
+   default:
+      break;
+   }
+   if(adc < 0 || adc >= Osci::nAdc){
+      std::cout << "Loopback ADC must be 0.." << Osci::nAdc - 1 << '\n';
+      exit(1);
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   std::string serial = Osci::boardSerial(&Ft232::context);
+   std::cout << "Board " << serial << ", loopback on ADC" << adc << '\n';
+
+   // Reference: spread of each kept reading over several runs at a slow clock
+   Osci::SpiSetting ref;
+   ref.divisor = (uint16_t) refDivisor;
+   std::vector<uint16_t> lo, hi, vals;
+   for(int run = 0; run < Osci::calibRuns; run++){
+      if(!measure(ref, adc, &vals)){
+         std::cout << "Reference run failed\n";
+         exit(1);
+      }
+      if(run == 0){
+         lo = hi = vals;
+      }
+      for(size_t i = 0; i < vals.size(); i++){
+         if(vals[i] < lo[i]) lo[i] = vals[i];
+         if(vals[i] > hi[i]) hi[i] = vals[i];
+      }
+   }
+
+   // Fastest first; the first setting without a single reading out of range wins
+   bool found = false;
+   Osci::SpiSetting best;
+   for(int d = 0; d <= refDivisor && !found; d++){
+      for(uint8_t edge : {(uint8_t) 0, (uint8_t) MPSSE_READ_NEG}){
+         Osci::SpiSetting s;
+         s.divisor = (uint16_t) d;
+         s.readEdge = edge;
+         int errors = 0;
+         for(int run = 0; run < Osci::calibRuns; run++){
+            if(!measure(s, adc, &vals)){
+               errors = -1;
+               break;
+            }
+            for(size_t i = 0; i < vals.size(); i++){
+               if(i % Osci::calibReads < Osci::calibSettle) continue;
+               if(vals[i] + tolerance < lo[i] || vals[i] > hi[i] + tolerance) errors++;
+            }
+         }
+         std::cout << "divisor " << d << " (" << 1000.0/Osci::skPeriodNs(s.divisor) << " MHz), "
+                   << Osci::edgeName(edge) << " edge: ";
+         if(errors < 0) std::cout << "transfer failed\n";
+         else std::cout << errors << " errors\n";
+         if(errors == 0){
+            best = s;
+            found = true;
+            break;
+         }
+      }
+   }
+
+   if(!found){
+      std::cout << "No setting matches the reference, check the loopback wiring\n";
+   }else if(!Osci::saveCalibration(Osci::calibPath(serial), best)){
+      std::cout << "Can't write " << Osci::calibPath(serial) << '\n';
+   }else{
+      std::cout << "Saved divisor " << best.divisor << ", " << Osci::edgeName(best.readEdge) << " edge to "
+                << Osci::calibPath(serial) << '\n';
+   }
+
+   // Clear system
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return found ? 0 : 1;
+}
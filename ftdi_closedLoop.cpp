@@ -0,0 +1,121 @@
+// Closed-loop control: every round trip writes the DAC, reads ADC0..2 and runs
+// the controller on the result to get the next DAC value. Loop time is reported
+// as a histogram.
+// Usage: ftdi_closedLoop [iterations] [setpoint V] [kp] [ki] [kd]
+
+// Windows:
+//g++ ftdi_closedLoop.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_closedLoop -Wall
+
+// Linux:
+//g++ ftdi_closedLoop.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_closedLoop -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/control.hpp>
+#include <osci/histogram.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/sampler.hpp>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+int main(int argc, char *argv[]){
+   int iterations = 10000;
+   float setpoint = 0.0; // volts on ADC0
+   float kp = 200.0;     // DAC codes per volt
+   float ki = 0.0;
+   float kd = 0.0;
+   switch (argc)
+   {
+   case 6:
+      kd = (float) std::stof(argv[5]);
+   case 5:
+      ki = (float) std::stof(argv[4]);
+   case 4:
+      kp = (float) std::stof(argv[3]);
+   case 3:
+      setpoint = (float) std::stof(argv[2]);
+   case 2:
+      iterations = (int) std::stoi(argv[1]);
+      break;
+
+   default:
+      break;
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   // Setup MPSSE
+   uint8_t cmd[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(cmd, &iWrite);
+   if ( ftdi_write_data(&Ft232::context, cmd, iWrite) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   // Round trips of one DAC write, 3 ADC conversions and their reads, flushed with SEND_IMMEDIATE
+   Osci::SingleShot shot(&Ft232::context);
+   if ( shot.init() != 0 ) {
+      std::cout << "Can't configure device for single-shot reads\n";
+      exit(1);
+   }
+   Osci::Pid pid(0, setpoint, kp, ki, kd);
+   uint16_t dacVal = Osci::dacMax/2;
+   uint16_t adc[Osci::nAdc];
+   std::vector<uint16_t> log; // dac, adc0, adc1, adc2 per iteration
+   log.reserve((size_t)iterations*(1+Osci::nAdc));
+   Osci::LatencyHistogram hist;
+
+   // Main loop. Each round trip converts after its DAC write, so adc is the response to dacVal.
+   auto prev = std::chrono::steady_clock::now();
+   for(int it = 0; it < iterations; it++){
+      if (shot.sample(dacVal, adc) != 0) {
+         std::cout << "Round trip failed\n";
+         break;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      double dt = std::chrono::duration<double>(now - prev).count();
+      prev = now;
+      if(it > 0) hist.add(dt*1e6); // the first iteration includes the setup
+
+      log.push_back(dacVal);
+      log.insert(log.end(), adc, adc + Osci::nAdc);
+      dacVal = pid.step(adc, dt);
+   }
+
+   // Report loop timing and write the trace
+   std::cout << "Loop time: ";
+   hist.print(std::cout);
+   std::cout << "USB round trip: ";
+   shot.roundTrip().print(std::cout);
+   std::ofstream outFile;
+   outFile.open("out.csv");
+   for(size_t i = 0; i < log.size(); i += 1+Osci::nAdc){
+      outFile << std::dec << log[i] << "; " << log[i+1] << "; " << log[i+2] << "; " << log[i+3] << "\n";
+   }
+   outFile.close();
+   std::cout << "Done\n";
+
+   // Clear system
+   iWrite = 0;
+   Osci::releaseCs(cmd, &iWrite);
+   ftdi_write_data(&Ft232::context, cmd, iWrite);
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return 0;
+}
@@ -0,0 +1,245 @@
+// Dual-engine acquisition on an FT2232H (or FT4232H): the DAC values of in.csv are
+// streamed on interface A while interface B runs the ADC scan frames, both at the
+// same frame period (see include/osci/dual.hpp). The ADC frames are merged with
+// the DAC values on their common sample index into out.csv.
+// Usage: ftdi_dual [--scan file] [--serial S] [--ft4232]
+
+// Windows:
+//g++ ftdi_dual.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -pthread -o build/ftdi_dual -Wall
+
+// Linux:
+//g++ ftdi_dual.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -pthread -o build/ftdi_dual -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/calib.hpp>
+#include <osci/dual.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <osci/timebase.hpp>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+
+namespace Osci{
+   const unsigned int chunkSize = 0x5FFFFFFE;
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const int32_t readStepFrames = 4096;         // ADC frames per read, one timestamp each
+   const int maxIdleReads = 100;                // status-only reads before giving up on the ticks
+}
+
+namespace Ft232 {
+   struct ftdi_context dacContext; // interface A
+   struct ftdi_context adcContext; // interface B
+}
+
+
+int main(int argc, char *argv[]){
+   const char* scanPath = NULL; // scan list file, default: ADC0..2 once per sample
+   const char* serial = NULL;   // board to open, default: the one used last
+   uint16_t product = Ft2232::product;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+      else if(strcmp(argv[a], "--ft4232") == 0) product = Ft4232::product;
+   }
+
+   // Open both interfaces of the same chip
+   int ftdi_status = Osci::openMpsse(&Ft232::dacContext, serial, INTERFACE_A, product);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open interface A. Got error\n"
+		<< ftdi_get_error_string(&Ft232::dacContext) << '\n';
+      exit(1);
+   }
+   char chipSerial[64]; // B of the chip A was found on
+   if(ftdi_usb_get_serial(&Ft232::dacContext, chipSerial, sizeof(chipSerial)) == 0 && chipSerial[0] != '\0'){
+      serial = chipSerial;
+   }
+   ftdi_status = Osci::openMpsse(&Ft232::adcContext, serial, INTERFACE_B, product);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open interface B. Got error\n"
+		<< ftdi_get_error_string(&Ft232::adcContext) << '\n';
+      exit(1);
+   }
+   for(struct ftdi_context* context : {&Ft232::dacContext, &Ft232::adcContext}){
+      ftdi_write_data_set_chunksize(context, Osci::writeChunkSize);
+      ftdi_write_data_set_queue_depth(context, Osci::writeQueueDepth);
+      ftdi_transfer_pool_reserve(context, 2, Osci::writeQueueDepth + 1); // a write and a read in flight
+      ftdi_read_data_set_chunksize(context, Osci::chunkSize);
+   }
+
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(Osci::boardSerial(&Ft232::adcContext));
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+
+   // Compile the scan list for B alone: only its CS release between frames, no DAC write
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::setBitsClocks)){
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout);
+   Osci::DualFrames frames = Osci::dualFrames(scan);
+   std::cout << "dual: " << frames.period << " SK clocks per frame (DAC " << Osci::dacFrameClocks << ", ADC "
+             << scan.frameClocks() << "), single engine " << scan.frameClocks() - Osci::setBitsClocks + Osci::dacWriteClocks << '\n';
+   const int32_t sampleReadBytes = scan.reads()*Osci::adcReadBytes;
+
+   std::ifstream inFile("in.csv");
+   std::string line;
+   std::vector<uint16_t> dacVals;
+   while(getline(inFile, line)){
+      dacVals.push_back((uint16_t) std::stoi(line));
+   }
+   inFile.close();
+   const int32_t nFrames = (int32_t) dacVals.size();
+   if((int64_t) nFrames*(int64_t) frames.adc.size() > INT32_MAX){
+      std::cout << "in.csv too long for a single capture\n";
+      exit(1);
+   }
+
+   // Setup: A configures the DAC, B only needs the clock and its pins
+   uint8_t setup[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(setup, &iWrite, spi.divisor);
+   if ( ftdi_write_data(&Ft232::dacContext, setup, iWrite) != iWrite ) {
+      std::cout << "Write failed on A\n";
+      exit(1);
+   }
+   iWrite = 0;
+   Osci::setupClock(setup, &iWrite, spi.divisor);
+   Osci::releaseCs(setup, &iWrite);
+   if ( ftdi_write_data(&Ft232::adcContext, setup, iWrite) != iWrite ) {
+      std::cout << "Write failed on B\n";
+      exit(1);
+   }
+   std::cout << "Config successful\n";
+
+   // A: per sample the DAC write and the shared tail, every dualTickFrames the
+   // tail ending with a tick, padded shorter by the tick
+   std::vector<uint8_t> dacCmd((size_t)nFrames*Osci::dacCmdBytes);
+   int32_t nTicks = 0;
+   const struct ftdi_iovec tailFrag = {frames.dacTail.data(), (int) frames.dacTail.size()};
+   const struct ftdi_iovec tickTailFrag = {frames.dacTickTail.data(), (int) frames.dacTickTail.size()};
+   std::vector<struct ftdi_iovec> dacStream;
+   dacStream.reserve(2*(size_t)nFrames);
+   int64_t dacStreamBytes = 0;
+   iWrite = 0;
+   for(int32_t f = 0; f < nFrames; f++){
+      int32_t at = iWrite;
+      Osci::writeDac(dacCmd.data(), &iWrite, dacVals[f]);
+      dacStream.push_back({dacCmd.data() + at, iWrite - at});
+      if((f + 1) % Osci::dualTickFrames == 0){
+         dacStream.push_back(tickTailFrag);
+         nTicks++;
+      }else{
+         dacStream.push_back(tailFrag);
+      }
+      dacStreamBytes += (iWrite - at) + dacStream.back().len;
+   }
+
+   // B: the same ADC frame, ending with its CS release, for every sample
+   const struct ftdi_iovec adcFrag = {frames.adc.data(), (int) frames.adc.size()};
+   std::vector<struct ftdi_iovec> adcStream(nFrames, adcFrag);
+   std::vector<uint8_t> readBuf((size_t)nFrames*sampleReadBytes);
+
+   // Start both engines back to back; A's ticks are read on their own thread
+   Osci::TimeBase dacTime, adcTime;
+   ftdi_tcoflush(&Ft232::dacContext);
+   ftdi_tcoflush(&Ft232::adcContext);
+   struct ftdi_transfer_control* dacTc = ftdi_write_datav_submit(&Ft232::dacContext, dacStream.data(), (int) dacStream.size());
+   struct ftdi_transfer_control* adcTc = dacTc != NULL
+      ? ftdi_write_datav_submit(&Ft232::adcContext, adcStream.data(), (int) adcStream.size()) : NULL;
+   if(dacTc == NULL || adcTc == NULL){
+      if(dacTc != NULL) ftdi_transfer_data_cancel(dacTc, NULL);
+      std::cout << "Can't start the streams\n";
+      exit(1);
+   }
+
+   int32_t ticks = 0;
+   std::thread tickReader([&]{
+      std::vector<uint8_t> tickBuf(nTicks > 0 ? nTicks : 1);
+      int idle = 0;
+      while(ticks < nTicks && idle < Osci::maxIdleReads){
+         int got = ftdi_read_data(&Ft232::dacContext, tickBuf.data() + ticks, nTicks - ticks);
+         if (got < 0) break;
+         idle = got == 0 ? idle + 1 : 0;
+         ticks += got;
+         if (got > 0) dacTime.mark((uint64_t) ticks*Osci::dualTickFrames);
+      }
+   });
+
+   int32_t readSize = nFrames*sampleReadBytes;
+   int32_t readStep = Osci::readStepFrames*sampleReadBytes;
+   int32_t nRead = 0;
+   while(nRead < readSize){
+      int32_t n = (readSize - nRead < readStep) ? readSize - nRead : readStep;
+      int got = ftdi_read_data(&Ft232::adcContext, readBuf.data() + nRead, n);
+      if (got > 0) nRead += got;
+      adcTime.mark(nRead/sampleReadBytes);
+      if (got != n) break;
+   }
+   tickReader.join();
+
+   // The writes are done once their engines produced every read, else cancelled
+   bool dacWritten = false, adcWritten = false;
+   if(ticks == nTicks) dacWritten = ftdi_transfer_data_done(dacTc) == dacStreamBytes;
+   else ftdi_transfer_data_cancel(dacTc, NULL);
+   if(nRead == readSize) adcWritten = ftdi_transfer_data_done(adcTc) == (int64_t) nFrames*(int64_t) frames.adc.size();
+   else ftdi_transfer_data_cancel(adcTc, NULL);
+   if(!dacWritten) std::cout << "Write failed on A\n";
+   if(!adcWritten) std::cout << "Write failed on B\n";
+
+   // Engines against each other: start skew and rate mismatch of the fitted time bases
+   double nominalNs = frames.period*Osci::skPeriodNs(spi.divisor);
+   int32_t skewFrames = 0; // frames A started after B
+   std::cout << "B: " << adcTime.nsPerFrame() << " ns/frame (nominal " << nominalNs << "), jitter "
+             << adcTime.jitterNs()/1000.0 << " us over " << adcTime.count() << " transfers\n";
+   if(dacTime.count() >= 2 && dacTime.nsPerFrame() > 0){
+      double skewNs = (double) (dacTime.startNs() - adcTime.startNs());
+      skewFrames = (int32_t) lround(skewNs/(adcTime.nsPerFrame() > 0 ? adcTime.nsPerFrame() : nominalNs));
+      std::cout << "A: " << dacTime.nsPerFrame() << " ns/frame, "
+                << dacTime.driftPpm(adcTime.nsPerFrame()) << " ppm against B, starts "
+                << skewNs/1000.0 << " us after B, " << skewFrames << " frames (" << ticks << " ticks)\n";
+   }else{
+      std::cout << "A: " << ticks << " of " << nTicks << " ticks, too few to time the engines against each other\n";
+   }
+   for(struct ftdi_context* context : {&Ft232::dacContext, &Ft232::adcContext}){
+      struct ftdi_line_status_stats lineStatus;
+      ftdi_get_line_status_stats(context, &lineStatus);
+      if(lineStatus.overruns > 0){
+         std::cout << "interface " << (context == &Ft232::dacContext ? 'A' : 'B') << ": "
+                   << lineStatus.overruns << " FIFO overruns\n";
+      }
+   }
+
+   if (nRead != readSize) {
+      std::cout << "Read failed\n";
+   }else if(dacWritten && adcWritten){
+      std::vector<uint16_t> samples((size_t)nFrames*scan.reads());
+      Osci::decodeFrames(readBuf.data(), nFrames, samples.data(), scan.reads());
+      std::ofstream outFile("out.csv");
+      int32_t rows = Osci::writeMerged(outFile, dacVals.data(), samples.data(), nFrames, scan.reads(), skewFrames);
+      std::cout << "out.csv: " << rows << " samples of DAC and " << scan.reads() << " ADC columns, DAC shifted by "
+                << skewFrames << " frames\n";
+   }
+   std::cout << "Done\n";
+
+   // Clear system
+   for(struct ftdi_context* context : {&Ft232::dacContext, &Ft232::adcContext}){
+      ftdi_tcioflush(context);
+      ftdi_usb_reset(context);
+      ftdi_usb_close(context);
+   }
+   return 0;
+}
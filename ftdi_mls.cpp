@@ -0,0 +1,211 @@
+// Impulse and frequency response from a maximum-length sequence: the DAC plays
+// an MLS of the given order for one settling period plus the averaged ones, the
+// periods of every ADC column are summed as they are read, and the mean period
+// is correlated with the sequence by fast Hadamard transform (see
+// include/osci/mls.hpp). Writes impulse.csv (sample, response per column, V/V)
+// and response.csv (frequency, then gain in dB and phase in degrees per column).
+// The offset of each column is taken out, and with it the DC gain, so
+// response.csv starts at the first bin above DC.
+// Usage: ftdi_mls [--order m] [--periods n] [--amplitude codes] [--offset codes] [--dacfs V]
+//                 [--scan file] [--serial S]
+
+// Windows:
+//g++ ftdi_mls.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_mls -Wall
+
+// Linux:
+//g++ ftdi_mls.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_mls -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/calib.hpp>
+#include <osci/mls.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <osci/spectrum.hpp>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+
+
+namespace Osci{
+   const unsigned int chunkSize = 0x5FFFFFFE;
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const int32_t readStepFrames = 4096;         // frames per read, averaged while the next arrive
+   const double adcSpan = 5.0;                  // ADC volts over 4095 codes (see codeToVolt)
+}
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+int main(int argc, char *argv[]){
+   int order = 12;         // sequence of 2^order - 1 frames
+   int periods = 8;        // periods averaged, after one to settle
+   int amplitude = 819;    // DAC codes around the offset
+   int offset = 2048;
+   double dacFullScale = Osci::adcSpan; // DAC volts over 4095 codes
+   const char* scanPath = NULL;
+   const char* serial = NULL;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--order") == 0 && a+1 < argc) order = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--periods") == 0 && a+1 < argc) periods = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--amplitude") == 0 && a+1 < argc) amplitude = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--offset") == 0 && a+1 < argc) offset = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--dacfs") == 0 && a+1 < argc) dacFullScale = std::stod(argv[++a]);
+      else if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+   }
+   if(order < Osci::mlsMinOrder || order > Osci::mlsMaxOrder || periods < 1){
+      std::cout << "The order must be " << Osci::mlsMinOrder << ".." << Osci::mlsMaxOrder << ", periods at least 1\n";
+      exit(1);
+   }
+   if(amplitude < 1 || offset - amplitude < 0 || offset + amplitude > 0xFFF){
+      std::cout << "The sequence must stay within the DAC codes 0..4095\n";
+      exit(1);
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context, serial);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   ftdi_write_data_set_chunksize(&Ft232::context, Osci::writeChunkSize);
+   ftdi_write_data_set_queue_depth(&Ft232::context, Osci::writeQueueDepth);
+   ftdi_transfer_pool_reserve(&Ft232::context, 1, Osci::writeQueueDepth);
+   ftdi_read_data_set_chunksize(&Ft232::context, Osci::chunkSize);
+
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(Osci::boardSerial(&Ft232::context));
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::dacWriteClocks)){
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout);
+   const int columns = scan.reads();
+   const int32_t sampleReadBytes = columns*Osci::adcReadBytes;
+
+   Osci::Mls mls(order);
+   const int32_t length = mls.length();
+   const int64_t nFrames = (int64_t) length*(periods + 1);
+   if(nFrames*(Osci::dacCmdBytes + scan.frameBytes()) > INT32_MAX || nFrames*sampleReadBytes > INT32_MAX){
+      std::cout << "Sequence too long for a single capture, lower --order or --periods\n";
+      exit(1);
+   }
+   double fs = 1e9/(scan.frameClocks()*Osci::skPeriodNs(spi.divisor));
+   std::cout << "MLS: order " << order << ", " << length << " frames per period, " << periods
+             << " periods averaged at " << fs/1e3 << " kS/s\n";
+
+   // Setup MPSSE
+   uint8_t setup[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(setup, &iWrite, spi.divisor);
+   if ( ftdi_write_data(&Ft232::context, setup, iWrite) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   // Two DAC levels and one ADC frame: the stream is fragments of these only
+   std::vector<uint8_t> highCmd(Osci::dacCmdBytes), lowCmd(Osci::dacCmdBytes), frameCmd(scan.frameBytes()),
+                        trailerCmd(Osci::releaseCmdBytes);
+   int32_t nCmd = 0, frameReads = 0;
+   Osci::writeDac(highCmd.data(), &nCmd, (uint16_t) (offset + amplitude));
+   nCmd = 0;
+   Osci::writeDac(lowCmd.data(), &nCmd, (uint16_t) (offset - amplitude));
+   nCmd = 0;
+   scan.append(frameCmd.data(), &nCmd, &frameReads);
+   nCmd = 0;
+   Osci::releaseCs(trailerCmd.data(), &nCmd);
+   const struct ftdi_iovec highFrag = {highCmd.data(), (int) highCmd.size()};
+   const struct ftdi_iovec lowFrag = {lowCmd.data(), (int) lowCmd.size()};
+   const struct ftdi_iovec frameFrag = {frameCmd.data(), (int) frameCmd.size()};
+   std::vector<struct ftdi_iovec> stream;
+   stream.reserve(2*(size_t)nFrames + 1);
+   for(int64_t f = 0; f < nFrames; f++){
+      stream.push_back(mls.level((int32_t) (f % length)) > 0 ? highFrag : lowFrag);
+      stream.push_back(frameFrag);
+   }
+   stream.push_back({trailerCmd.data(), (int) trailerCmd.size()});
+
+   // Sum the periods of every column while the rest of the capture comes in
+   Osci::MlsAverager averager(length, columns);
+   std::vector<uint8_t> readBuf((size_t)Osci::readStepFrames*sampleReadBytes);
+   std::vector<uint16_t> adc((size_t)Osci::readStepFrames*columns);
+   auto t0 = std::chrono::steady_clock::now();
+   ftdi_tcoflush(&Ft232::context);
+   struct ftdi_transfer_control* tc = ftdi_write_datav_submit(&Ft232::context, stream.data(), (int) stream.size());
+   int64_t nRead = 0;
+   while(tc != NULL && nRead < nFrames){
+      int32_t n = (nFrames - nRead < Osci::readStepFrames) ? (int32_t) (nFrames - nRead) : Osci::readStepFrames;
+      int got = ftdi_read_data(&Ft232::context, readBuf.data(), n*sampleReadBytes);
+      if (got != n*sampleReadBytes) break;
+      Osci::decodeFrames(readBuf.data(), n, adc.data(), columns);
+      averager.process(adc.data(), n);
+      nRead += n;
+   }
+   if(tc != NULL){
+      if(nRead == nFrames) ftdi_transfer_data_done(tc);
+      else ftdi_transfer_data_cancel(tc, NULL);
+   }
+   if(nRead != nFrames){
+      std::cout << "Read failed after " << nRead << " of " << nFrames << " frames\n";
+      exit(1);
+   }
+
+   // Impulse responses in V/V, with each slot's conversion latency and offset taken out
+   double scale = Osci::adcSpan/(dacFullScale*amplitude);
+   std::vector<std::vector<double>> h(columns, std::vector<double>(length));
+   std::vector<double> y(length), hc(length);
+   for(int c = 0; c < columns; c++){
+      averager.mean(c, y.data());
+      mls.impulse(y.data(), hc.data());
+      for(int32_t k = 0; k < length; k++) h[c][k] = hc[(k + scan.latency(c)) % length]*scale;
+   }
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   std::cout << averager.periods() << " periods averaged, " << secs << " s including the capture\n";
+
+   std::ofstream impulseFile("impulse.csv");
+   impulseFile.precision(7);
+   for(int32_t k = 0; k < length; k++){
+      impulseFile << k;
+      for(int c = 0; c < columns; c++) impulseFile << "; " << h[c][k];
+      impulseFile << '\n';
+   }
+   impulseFile.close();
+
+   Osci::Fft fft(length + 1);
+   std::vector<std::vector<std::complex<double>>> H;
+   for(int c = 0; c < columns; c++) H.push_back(Osci::frequencyResponse(h[c].data(), length, fft));
+   std::ofstream responseFile("response.csv");
+   responseFile.precision(6);
+   for(size_t k = 1; k < H[0].size(); k++){
+      responseFile << k*fs/fft.size();
+      for(int c = 0; c < columns; c++){
+         responseFile << "; " << 20*log10(std::abs(H[c][k])) << "; " << std::arg(H[c][k])*180/M_PI;
+      }
+      responseFile << '\n';
+   }
+   responseFile.close();
+   std::cout << "impulse.csv: " << length << " samples, response.csv: " << H[0].size() - 1
+             << " frequencies up to " << fs/2e3 << " kHz\nDone\n";
+
+   // Clear system
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return 0;
+}
@@ -0,0 +1,79 @@
+// Polling monitor: fetches one fresh ADC0..2 sample set per request through the
+// single-shot API (converted within the request, see include/osci/sampler.hpp)
+// and reports the USB round-trip latency histogram.
+// Usage: ftdi_poll [samples] [period us]
+
+// Windows:
+//g++ ftdi_poll.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_poll -Wall
+
+// Linux:
+//g++ ftdi_poll.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_poll -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/sampler.hpp>
+#include <iostream>
+#include <thread>
+
+
+namespace Ft232 {
+   struct ftdi_context context;
+}
+
+
+int main(int argc, char *argv[]){
+   int nsamples = 1000;
+   int period = 0; // us between requests, 0: back to back
+   switch (argc)
+   {
+   case 3:
+      period = (int) std::stoi(argv[2]);
+   case 2:
+      nsamples = (int) std::stoi(argv[1]);
+      break;
+
+   default:
+      break;
+   }
+
+   // Initialize FTDI chip
+   int ftdi_status = Osci::openMpsse(&Ft232::context);
+   if ( ftdi_status != 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+   uint8_t cmd[Osci::setupCmdBytes];
+   int32_t iWrite = 0;
+   Osci::setupMpsse(cmd, &iWrite);
+   if ( ftdi_write_data(&Ft232::context, cmd, iWrite) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   Osci::SingleShot shot(&Ft232::context);
+   if ( shot.init() != 0 ) {
+      std::cout << "Can't configure device for single-shot reads\n";
+      exit(1);
+   }
+
+   uint16_t adc[Osci::nAdc];
+   shot.sample(adc); // the first value read not always reliable
+   shot.roundTrip().reset();
+   for(int t = 0; t < nsamples; t++){
+      if (shot.sample(adc) != 0) {
+         std::cout << "Round trip failed\n";
+         break;
+      }
+      std::cout << std::dec << adc[0] << "; " << adc[1] << "; " << adc[2] << "\n";
+      if(period > 0) std::this_thread::sleep_for(std::chrono::microseconds(period));
+   }
+   std::cout << "Round trip: ";
+   shot.roundTrip().print(std::cout);
+
+   // Clear system
+   ftdi_tcioflush(&Ft232::context);
+   ftdi_usb_reset(&Ft232::context);
+   ftdi_usb_close(&Ft232::context);
+   return 0;
+}
@@ -1,85 +1,78 @@
 // Windows:
-//g++ ftdi_readWrite.cpp -I include/ -L include/libftdi -lftdi1 -lftdipp1 -o build/ftdi_readWrite -Wall
+//g++ ftdi_readWrite.cpp -x c include/libftdi/ftdi.c -x none -I include/ -O3 -mssse3 $(pkg-config --cflags --libs libusb-1.0) -lws2_32 -lmswsock -pthread -o build/ftdi_readWrite -Wall
 
 // Linux:
-//g++ ftdi_readWrite.cpp -I include/ -L include/libftdi -lftdi1 -lftdipp1 -lusb-1.0 -o build/ftdi_readWrite -Wall
+//g++ ftdi_readWrite.cpp -x c include/libftdi/ftdi.c -x none -I include/ -O3 -mssse3 $(pkg-config --cflags --libs libusb-1.0) -lrt -pthread -o build/ftdi_readWrite -Wall
 
 
 #include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/buffer.hpp>
+#include <osci/calib.hpp>
+#include <osci/codec.hpp>
+#include <osci/decimate.hpp>
+#include <osci/netserver.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <osci/shmring.hpp>
+#include <osci/spectrum.hpp>
+#include <osci/sync.hpp>
+#include <osci/timebase.hpp>
+#include <osci/trigger.hpp>
 #include <stdio.h>
 #include <iostream>
 #include <string.h>
 #include <fstream>
+#include <vector>
+#include <chrono>
+#include <memory>
 
 
 namespace Osci{
-   const uint32_t bufSize = 100000000;
    const unsigned int chunkSize = 0x5FFFFFFE;
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const size_t setupBytes = setupCmdBytes;     // MPSSE setup and DAC configuration
+   const size_t trailerBytes = releaseCmdBytes; // CS reset
+   const int32_t liveReadFrames = 16*ringBlockFrames; // frames per read, one timestamp each
 }
 
-// Config for FT232
 namespace Ft232 {
-   // Enumerate the AD bus for convenience.
-   enum pins {
-      SK = 0x01, // ADBUS0, SPI data clock
-      DO = 0x02, // ADBUS1, SPI data out
-      DI = 0x04, // ADBUS2, SPI data in
-      CS0 = 0x08, // ADBUS3, SPI chip select
-      CS1 = 0x10, // ADBUS4, general-ourpose i/o, GPIOL0
-      CS2 = 0x20, // ADBUS5, general-ourpose i/o, GPIOL1
-      CS3 = 0x40, // ADBUS6, general-ourpose i/o, GPIOL2
-      l3 = 0x80  // ADBUS7, general-ourpose i/o, GPIOL3
-   };
-   
-   // Chip-specific info
-   const uint16_t vendor = 0x0403;
-   const uint16_t product = 0x6014;
-
-   const uint8_t pinInitialState = pins::CS0|pins::CS1|pins::CS2|pins::CS3; // Set these pins high
-   const uint8_t pinDirection    = pins::SK|pins::DO|pins::CS0|pins::CS1|pins::CS2|pins::CS3; // Use these pins as outputs
-
    struct ftdi_context context;
 }
 
-// DAC register offsets
-namespace Dacx0501{
-   const uint8_t DAC_DATA = 0x08;
-   const uint8_t CONFIG = 0x03;
-}
-
-// ADC configuration bits
-namespace Lt230x{
-   enum config{
-      SINGLE_ENDED = 0x80,
-      ODD = 0x40,
-      UNIPOLAR = 0x08
-   };
-}
-
-// Convert Dacx0501 12bit 2-complement output to volts
-float outToVolt(uint16_t out){
-   uint16_t sign = out&0x800;
-   float ret = -1.0*sign + 1.0*(out&0x7FF);
-   ret = (((ret+2048.0)/4095.0)*5.0)-2.5;
-   return ret;
-}
-
-
-int main(void){
-   // Prepare buffers and indices
-   uint8_t* writeBuf = (uint8_t*) calloc(Osci::bufSize, sizeof(uint8_t));
-   if(writeBuf == NULL){
-      std::cout << "Failed to allocate writeBuf\n";
-      exit(1);
-   }
-   int32_t iWrite = 0;
-   
-   uint8_t* readBuf = (uint8_t*) calloc(Osci::bufSize, sizeof(uint8_t));
-   if(readBuf == NULL){
-      std::cout << "Failed to allocate readBuf\n";
-      exit(1);
+int main(int argc, char *argv[]){
+   bool hugePages = false; // back large buffers with huge pages
+   int codec = -1;         // -1: write out.csv, else write out.osc with this codec
+   const char* shmName = NULL; // publish decoded blocks to this shared-memory ring
+   int servePort = -1;         // stream decoded blocks over TCP on this port
+   const char* scanPath = NULL; // scan list file, default: ADC0..2 once per sample
+   bool sync = false;          // insert sync markers and resynchronize on lost bytes
+   const char* decimation = NULL; // decimation factor(s), writes out_ch<c>.csv instead of out.csv
+   const char* serial = NULL;  // board to open, default: the one used last
+   int analyzeSize = 0;        // FFT length of the SNR/SINAD/THD/SFDR/ENOB analyzer, 0: off
+   int analyzeTones = 1;       // input tones counted as signal
+   int triggerColumn = -1;     // column watched by the edge trigger, -1: off
+   double triggerLevel = 0;    // trigger level in volts
+   bool triggerRising = true;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--hugepages") == 0) hugePages = true;
+      else if(strcmp(argv[a], "--packed") == 0) codec = Osci::PACKED12;
+      else if(strcmp(argv[a], "--delta") == 0) codec = Osci::DELTA;
+      else if(strcmp(argv[a], "--shm") == 0 && a+1 < argc) shmName = argv[++a];
+      else if(strcmp(argv[a], "--serve") == 0 && a+1 < argc) servePort = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--sync") == 0) sync = true;
+      else if(strcmp(argv[a], "--decimate") == 0 && a+1 < argc) decimation = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+      else if(strcmp(argv[a], "--analyze") == 0 && a+1 < argc) analyzeSize = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--tones") == 0 && a+1 < argc) analyzeTones = std::stoi(argv[++a]);
+      else if(strcmp(argv[a], "--trigger") == 0 && a+2 < argc){
+         triggerColumn = std::stoi(argv[++a]);
+         triggerLevel = std::stod(argv[++a]);
+      }
+      else if(strcmp(argv[a], "--falling") == 0) triggerRising = false;
    }
-   int32_t iRead = 0;
 
    // Initialize FTDI chip
    int ftdi_status = ftdi_init(&Ft232::context);
@@ -87,7 +80,7 @@ int main(void){
       std::cout << "Failed to initialize device\n";
       exit(1);
    }
-   ftdi_status = ftdi_usb_open(&Ft232::context, Ft232::vendor, Ft232::product);
+   ftdi_status = Osci::openDevice(&Ft232::context, Ft232::vendor, Ft232::product, serial); // cached location first
    if ( ftdi_status != 0 ) {
       std::cout << "Can't open device. Got error\n"
 		<< ftdi_get_error_string(&Ft232::context) << '\n';
@@ -99,39 +92,93 @@ int main(void){
    ftdi_set_bitmode(&Ft232::context, 0, BITMODE_MPSSE); // enable mpsse on all bits
    ftdi_tcioflush(&Ft232::context);
    
-   // Max out chunksize
-   ftdi_write_data_set_chunksize(&Ft232::context, Osci::chunkSize);
+   // Max out the read chunksize, keep several write chunks in flight so the chip's FIFO never drains
+   ftdi_write_data_set_chunksize(&Ft232::context, Osci::writeChunkSize);
+   ftdi_write_data_set_queue_depth(&Ft232::context, Osci::writeQueueDepth);
+   ftdi_transfer_pool_reserve(&Ft232::context, 2, Osci::writeQueueDepth + 1); // a write and a read in flight
    ftdi_read_data_set_chunksize(&Ft232::context, Osci::chunkSize);
 
+   // Clock divisor and read edge found by ftdi_calibrate for this board, 30 MHz and rising edge otherwise
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(Osci::boardSerial(&Ft232::context));
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+
+   // Compile the scan list into the per-sample frame
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::dacWriteClocks)){ // DAC write between frames
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout); // column mapping and frame cost
+   std::vector<int> decimFactors;
+   if(decimation != NULL && !Osci::parseFactors(decimation, scan.reads(), &decimFactors)){
+      std::cout << "Decimation needs one factor or one per column (" << scan.reads() << ")\n";
+      exit(1);
+   }
+   if(analyzeSize != 0 && (!Osci::Fft::validSize(analyzeSize) || analyzeTones < 1)){
+      std::cout << "--analyze needs a power of two of at least 64, --tones at least 1\n";
+      exit(1);
+   }
+   if(triggerColumn >= scan.reads()){
+      std::cout << "Trigger column " << triggerColumn << " not in the scan list\n";
+      exit(1);
+   }
+   const size_t sampleWriteBytes = Osci::dacCmdBytes + scan.frameBytes(); // DAC write and the ADC reads per input line
+   const size_t sampleReadBytes = scan.reads()*Osci::adcReadBytes;        // ADC values on 2 bytes each
+
+   // Read the input csv first to size the buffers exactly
+   std::ifstream inFile;
+   inFile.open("in.csv");
+   std::string line;
+   std::vector<uint16_t> dacVals;
+   while(getline(inFile, line)){
+      dacVals.push_back((uint16_t) std::stoi(line)); // Format read line
+   }
+   inFile.close(); // close the input file
+
+   size_t streamSize = dacVals.size()*sampleWriteBytes + Osci::trailerBytes;
+   size_t readSize = dacVals.size()*sampleReadBytes;
+   size_t nMarkers = sync ? dacVals.size()/Osci::syncBlockFrames + 1 : 0;
+   streamSize += nMarkers*Osci::syncCmdBytes;
+   readSize += nMarkers*Osci::syncMarkerBytes;
+   // Only the setup and the DAC writes are stored, the rest of the stream is shared fragments
+   size_t writeSize = dacVals.size()*Osci::dacCmdBytes;
+   if(writeSize < Osci::setupBytes){
+      writeSize = Osci::setupBytes;
+   }
+   if(streamSize > INT32_MAX){
+      std::cout << "in.csv too long for a single capture\n";
+      exit(1);
+   }
+
+   // Prepare buffers and indices
+   Osci::Buffer writeMem, readMem;
+   if(!Osci::allocBuffer(&writeMem, writeSize, hugePages)){
+      std::cout << "Failed to allocate writeBuf\n";
+      exit(1);
+   }
+   uint8_t* writeBuf = writeMem.data;
+   int32_t iWrite = 0;
+   
+   if(!Osci::allocBuffer(&readMem, readSize, hugePages)){
+      std::cout << "Failed to allocate readBuf\n";
+      exit(1);
+   }
+   uint8_t* readBuf = readMem.data;
+   int32_t iRead = 0;
+
    // Sleep 50 ms for setup to complete
    // struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000000};
    // nanosleep(&ts, NULL); 
    
    // Setup MPSSE; Operation code followed by 0 or more arguments.
-   writeBuf[iWrite++] = 0x8A;            // opcode: disable div by 5
-   
-   writeBuf[iWrite++] = TCK_DIVISOR;     // opcode: set clk divisor
-   writeBuf[iWrite++] = 0x00;            // argument: low bit. 60 MHz / ((1+0)*2) = 30 MHz
-   writeBuf[iWrite++] = 0x00;            // argument: high bit.
-   
-   writeBuf[iWrite++] = DIS_ADAPTIVE;    // opcode: disable adaptive clocking
-   
-   writeBuf[iWrite++] = DIS_3_PHASE;     // opcode: disable 3-phase clocking
-   
-   writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-   writeBuf[(iWrite)++] = Ft232::pinInitialState & ~Ft232::CS3; // argument: inital pin states, select DAC
-   writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction
-
-   writeBuf[(iWrite)++] = MPSSE_DO_WRITE; // opcode: write on rising clock edge
-   writeBuf[(iWrite)++] = 0x02; // argument: length low byte, 0x0002 ==> 3 bytes
-   writeBuf[(iWrite)++] = 0x00; // argument: length high byte
-   writeBuf[(iWrite)++] = Dacx0501::CONFIG; // argument: first byte content -> configure DAC
-   writeBuf[(iWrite)++] = (uint8_t) 0x01; // argument: second byte content -> disable internal ref
-   writeBuf[(iWrite)++] = (uint8_t) 0x00; // argument: third byte content 
-   
-   writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-   writeBuf[(iWrite)++] = Ft232::pinInitialState; // argument: inital pin states, default
-   writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction (keep default)
+   Osci::setupMpsse(writeBuf, &iWrite, spi.divisor); // calibrated clock, DAC with external reference
 
    // Write the setup to the chip.
    if ( ftdi_write_data(&Ft232::context, writeBuf, iWrite) != iWrite ) {
@@ -140,115 +187,246 @@ int main(void){
       std::cout << "Config successful\n";
    }
 
-   // Zero the buffer after using it for initialisation
-   memset(writeBuf, 0, Osci::bufSize);
+   // Reuse the buffer after using it for initialisation
    iWrite = 0;
 
-   // Prepare input csv reading
-   std::ifstream inFile;
-   inFile.open("in.csv");
-   std::string line;
-
-   // Main loop: Read the input buffer, send it line-by-line to DAC
+   // The frame of ADC reads, the sync marker and the CS reset are the same for every
+   // input line: build them once and reference them from the fragment list
+   std::vector<uint8_t> frameCmd(scan.frameBytes()), syncCmd(Osci::syncCmdBytes), trailerCmd(Osci::trailerBytes);
+   int32_t nCmd = 0, frameReads = 0, syncReads = 0;
+   scan.append(frameCmd.data(), &nCmd, &frameReads); // ADC reads, by default ADC0..2 with config 0x00
+   nCmd = 0;
+   Osci::appendSync(syncCmd.data(), &nCmd, &syncReads);
+   nCmd = 0;
+   Osci::releaseCs(trailerCmd.data(), &nCmd);
+   const struct ftdi_iovec frameFrag = {frameCmd.data(), (int) frameCmd.size()};
+   const struct ftdi_iovec syncFrag = {syncCmd.data(), (int) syncCmd.size()};
+   std::vector<struct ftdi_iovec> stream;
+   stream.reserve(2*dacVals.size() + nMarkers + 1);
+
+   // Main loop: Send the input values one-by-one to DAC
    // Fill the read buffer line-by-line with the measurements
-   while(getline(inFile, line)){
-      uint16_t dacVal = (uint16_t) std::stoi(line); // Format read line
-
-      //Write DAC
-      writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-      writeBuf[(iWrite)++] = Ft232::pinInitialState & ~Ft232::CS3; // argument: inital pin states, select DAC
-      writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction
-
-      writeBuf[(iWrite)++] = MPSSE_DO_WRITE; // opcode: write on rising clock edge
-      writeBuf[(iWrite)++] = 0x02; // argument: length low byte, 0x0002 ==> 3 bytes
-      writeBuf[(iWrite)++] = 0x00; // argument: length high byte
-      writeBuf[(iWrite)++] = Dacx0501::DAC_DATA; // argument: first byte content -> send DAC value
-      writeBuf[(iWrite)++] = (uint8_t) (((dacVal & 0x0FF0) >> 4) & 0x00FF); // argument: second byte content -> send MSB
-      writeBuf[(iWrite)++] = (uint8_t) ((dacVal & 0x000F) << 4); // argument: second byte content -> send first LSB
-      // 60501 has 12bits, and needs the 4 last ones to be 0
-
-      // Read ADC0
-      writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-      writeBuf[(iWrite)++] = Ft232::pinInitialState & ~Ft232::CS0; // argument: inital pin states, select ADC0
-      writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction
-
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_DO_WRITE; // opcode: write on rising clock edge, read on rising clock edge
-      writeBuf[(iWrite)++] = 0x00; // length low byte, 0x0000 ==> 1 bytes
-      writeBuf[(iWrite)++] = 0x00; // length high byte
-      writeBuf[(iWrite)++] = 0x00;//Lt230x::UNIPOLAR;
-
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_BITMODE; // opcode: write on rising clock edge, read on rising clock edge
-      writeBuf[(iWrite)++] = 0x03; // length, 0x0003 ==> 4 bits
-      (iRead) += 2; // read 12 bits on 2 bytes (the MSB of the second byte is irrelevant)
-
-      // Read ADC1
-      writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-      writeBuf[(iWrite)++] = Ft232::pinInitialState & ~Ft232::CS1; // argument: inital pin states, select ADC1
-      writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction
-
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_DO_WRITE ; // opcode: write on rising clock edge, read on rising clock edge
-      writeBuf[(iWrite)++] = 0x00; // length low byte, 0x0000 ==> 1 bytes
-      writeBuf[(iWrite)++] = 0x00; // length high byte
-      writeBuf[(iWrite)++] = 0x00;//Lt230x::UNIPOLAR;
-
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_BITMODE ; // opcode: write on rising clock edge, read on rising clock edge
-      writeBuf[(iWrite)++] = 0x03; // length, 0x0003 ==> 4 bits
-      (iRead) += 2; // read 12 bits on 2 bytes (the MSB of the second byte is irrelevant)
-
-      // Read ADC2
-      writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-      writeBuf[(iWrite)++] = Ft232::pinInitialState & ~Ft232::CS2; // argument: inital pin states, select ADC2
-      writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction
+   size_t nVal = 0;
+   for(uint16_t dacVal : dacVals){
+      int32_t at = iWrite;
+      Osci::writeDac(writeBuf, &iWrite, dacVal);
+      stream.push_back({writeBuf + at, iWrite - at});
+      stream.push_back(frameFrag);
+      iRead += frameReads;
+      if(sync && ++nVal % Osci::syncBlockFrames == 0){
+         stream.push_back(syncFrag); // marker after each block
+         iRead += syncReads;
+      }
+   }
+   if(sync && nVal % Osci::syncBlockFrames != 0){
+      stream.push_back(syncFrag); // marker after the last, shorter block
+      iRead += syncReads;
+   }
 
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_DO_WRITE ; // opcode: write on rising clock edge, read on rising clock edge
-      writeBuf[(iWrite)++] = 0x00; // length low byte, 0x0000 ==> 1 bytes
-      writeBuf[(iWrite)++] = 0x00; // length high byte
-      writeBuf[(iWrite)++] = 0x00; //Lt230x::UNIPOLAR;
+   // Reset CS pins
+   stream.push_back({trailerCmd.data(), (int) trailerCmd.size()});
+   int32_t streamBytes = 0;
+   for (const struct ftdi_iovec& frag : stream) streamBytes += frag.len;
+
+   std::unique_ptr<Osci::RingWriter> ring;
+   if(shmName != NULL){
+      try{
+         ring.reset(new Osci::RingWriter(shmName, scan.reads()));
+      }catch(boost::interprocess::interprocess_exception& e){
+         std::cout << "Can't create shared memory " << shmName << ": " << e.what() << '\n';
+         exit(1);
+      }
+   }
 
-      writeBuf[(iWrite)++] = MPSSE_DO_READ | MPSSE_BITMODE ; // opcode: write on rising clock edge, read on falling clock edge
-      writeBuf[(iWrite)++] = 0x03; // length, 0x0003 ==> 4 bits
-      (iRead) += 2; // read 12 bits on 2 bytes (the MSB of the second byte is irrelevant)
+   std::unique_ptr<Osci::NetServer> server;
+   if(servePort >= 0){
+      try{
+         server.reset(new Osci::NetServer((uint16_t) servePort));
+      }catch(boost::system::system_error& e){
+         std::cout << "Can't listen on port " << servePort << ": " << e.what() << '\n';
+         exit(1);
+      }
    }
-   inFile.close(); // close the input file
 
-   // Reset CS pins
-   writeBuf[(iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
-   writeBuf[(iWrite)++] = Ft232::pinInitialState; // argument: inital pin states, default
-   writeBuf[(iWrite)++] = Ft232::pinDirection; // argument: pin direction (keep default)
+   // Figures of merit per column and trigger events, computed on the blocks as they arrive
+   std::unique_ptr<Osci::ChannelAnalyzers> analyzers;
+   if(analyzeSize != 0){
+      analyzers.reset(new Osci::ChannelAnalyzers(scan.reads(), analyzeSize, analyzeTones));
+   }
+   std::unique_ptr<Osci::EdgeTrigger> trigger;
+   std::vector<uint64_t> triggerFrames;
+   if(triggerColumn >= 0){
+      trigger.reset(new Osci::EdgeTrigger(triggerColumn, Osci::voltToCode(triggerLevel), triggerRising));
+   }
+   // Frames are decoded once, as they arrive, for the ring, the server, the analyzers
+   // and the trigger; straight into samples when a capture file or decimated output
+   // needs the whole capture after it, else block by block into liveBuf
+   bool live = ring || server || analyzers || trigger;
+   bool keepLive = live && (codec >= 0 || !decimFactors.empty());
+   std::vector<uint16_t> samples, liveBuf;
+   if (keepLive) samples.resize((size_t)(iRead/sampleReadBytes)*scan.reads());
+   std::vector<float> spectrum;
+   int32_t nDecoded = 0;     // frames decoded live
+   uint64_t nPublished = 0;  // averaged spectra sent to the TCP clients
 
    // Write and read data from Ft232
-   ftdi_usb_purge_tx_buffer(&Ft232::context);
-   ftdi_write_data_submit(&Ft232::context, writeBuf, iWrite);
-   
+   Osci::TimeBase timeBase;
+   ftdi_tcoflush(&Ft232::context);
+   ftdi_reset_line_status_stats(&Ft232::context);
+   struct ftdi_transfer_control* tc = ftdi_write_datav_submit(&Ft232::context, stream.data(), (int) stream.size());
+   if (tc == NULL) {
+      std::cout << "Can't start the write stream: " << ftdi_get_error_string(&Ft232::context) << '\n';
+      exit(1);
+   }
+
    // Get the data that was read
-   // Open output file
-   std::ofstream outFile;
-   outFile.open("out.csv");
-   
    float res = 0; // value to store the average
-   if (ftdi_read_data(&Ft232::context, readBuf, iRead) != iRead) std::cout << "Read failed\n"; // fill the readBuf with the read data, test for length
+   // Fill the readBuf with the read data in pieces, time-stamping each piece.
+   // With sync markers the good frames are compacted at the front of readBuf as they arrive.
+   Osci::SyncStream syncStream(sampleReadBytes);
+   int32_t readStep = sync ? 16*(Osci::syncBlockFrames*sampleReadBytes + Osci::syncMarkerBytes) : Osci::liveReadFrames*sampleReadBytes;
+   int32_t nRead = 0; // raw bytes received
+   int32_t nGood = 0; // bytes of frames ready to decode
+   while(nRead < iRead){
+      int32_t n = (iRead - nRead < readStep) ? iRead - nRead : readStep;
+      int got = ftdi_read_data(&Ft232::context, readBuf + nRead, n);
+      if (got > 0) nRead += got;
+      if (got != n && !sync) break;
+      int32_t ready = sync ? syncStream.process(readBuf, nRead, got != n || nRead == iRead) : nRead;
+      timeBase.mark(sync ? ready/sampleReadBytes + syncStream.stats.droppedFrames : nRead/sampleReadBytes);
+      if (live && ready/(int32_t) sampleReadBytes > nDecoded) {
+         int32_t nNew = ready/(int32_t) sampleReadBytes - nDecoded;
+         if (!keepLive) liveBuf.resize((size_t)nNew*scan.reads());
+         uint16_t* fresh = keepLive ? samples.data() + (size_t)nDecoded*scan.reads() : liveBuf.data();
+         Osci::decodeFrames(readBuf + (size_t)nDecoded*sampleReadBytes, nNew, fresh, scan.reads());
+         if (ring) ring->publish(fresh, nNew);
+         if (server) server->publishSamples(fresh, nNew, scan.reads());
+         if (analyzers) analyzers->process(fresh, nNew);
+         if (analyzers && server && analyzers->blocks() > nPublished) {
+            // The running average after each new block, per column
+            for (int c = 0; c < analyzers->channels(); c++) {
+               analyzers->magnitudes(c, &spectrum);
+               server->publishSpectrum(c, nDecoded + nNew, spectrum.data(), spectrum.size());
+            }
+            nPublished = analyzers->blocks();
+         }
+         if (trigger) {
+            size_t before = triggerFrames.size();
+            trigger->process(fresh, nNew, scan.reads(), nDecoded, &triggerFrames);
+            for (size_t i = before; server && i < triggerFrames.size(); i++) server->publishTrigger(triggerColumn, triggerFrames[i]);
+         }
+         nDecoded += nNew;
+      }
+      nGood = ready;
+      if (got != n) break;
+   }
+   // The write is done once the chip produced every read, else cancelled
+   bool allRead = nRead == iRead, written = false;
+   if (allRead) written = ftdi_transfer_data_done(tc) == streamBytes;
+   else ftdi_transfer_data_cancel(tc, NULL);
+   if (sync){
+      std::cout << "sync: " << syncStream.stats.blocks << " blocks, " << syncStream.stats.resyncs << " resyncs, "
+                << syncStream.stats.droppedFrames << " frames dropped";
+      if (nRead != iRead) std::cout << ", " << iRead - nRead << " bytes missing at the end";
+      std::cout << '\n';
+      iRead = nGood; // decode the good frames only
+   }
+   double nominalNs = scan.frameClocks()*Osci::skPeriodNs(spi.divisor);
+   std::cout << "timebase: " << timeBase.nsPerFrame() << " ns/frame (nominal " << nominalNs << "), drift "
+             << timeBase.driftPpm(nominalNs) << " ppm, jitter " << timeBase.jitterNs()/1000.0 << " us over "
+             << timeBase.count() << " transfers\n";
+   if (analyzers) {
+      double nsPerFrame = timeBase.nsPerFrame() > 0 ? timeBase.nsPerFrame() : nominalNs;
+      std::cout << "analysis at " << 1e6/nsPerFrame << " kS/s per column, " << analyzeSize << "-point FFT:\n";
+      analyzers->print(std::cout, 1e9/nsPerFrame);
+   }
+   if (trigger) {
+      std::cout << "trigger: " << triggerFrames.size() << (triggerRising ? " rising" : " falling") << " edges through "
+                << triggerLevel << " V on column " << triggerColumn;
+      for (size_t i = 0; i < triggerFrames.size() && i < 8; i++) std::cout << (i == 0 ? ", at frame " : ", ") << triggerFrames[i];
+      std::cout << (triggerFrames.size() > 8 ? ", ...\n" : "\n");
+   }
+   struct ftdi_transfer_pool_stats pool;
+   if (ftdi_transfer_pool_get_stats(&Ft232::context, &pool) == 0 && pool.control_misses + pool.transfer_misses > 0) {
+      std::cout << "transfer pool exhausted: " << pool.control_misses << " control and " << pool.transfer_misses
+                << " transfer allocations, peak " << pool.controls_peak << '/' << pool.transfers_peak << " in use\n";
+   }
+   // Device FIFO overruns, at their frame in the raw stream (before any resync)
+   struct ftdi_line_status_stats lineStatus;
+   ftdi_get_line_status_stats(&Ft232::context, &lineStatus);
+   std::vector<uint64_t> overrunFrames;
+   for (unsigned long i = 0; i < lineStatus.overruns && i < FTDI_OVERRUN_POSITIONS; i++) {
+      uint64_t pos = lineStatus.overrun_pos[i];
+      uint64_t span = (uint64_t) Osci::syncBlockFrames*sampleReadBytes + Osci::syncMarkerBytes;
+      overrunFrames.push_back(sync ? pos/span*Osci::syncBlockFrames + std::min<uint64_t>((pos % span)/sampleReadBytes, Osci::syncBlockFrames - 1)
+                                   : pos/sampleReadBytes);
+   }
+   if (lineStatus.overruns + lineStatus.errors > 0) {
+      std::cout << "line status: " << lineStatus.overruns << " overruns, " << lineStatus.errors << " errors in "
+                << lineStatus.packets << " packets";
+      for (size_t i = 0; i < overrunFrames.size(); i++) std::cout << (i == 0 ? ", overrun at frame " : ", ") << overrunFrames[i];
+      std::cout << '\n';
+   }
+   if (!sync && nRead != iRead) std::cout << "Read failed\n"; // test for length
+   else if (allRead && !written) std::cout << "Write failed\n";
+   else if (codec < 0 && decimFactors.empty()) {
+      // Open output file
+      std::ofstream outFile;
+      outFile.open("out.csv");
+      res = Osci::postProcess(readBuf, iRead, outFile, 0, scan.reads()); // decode the ADC values on all cores, sum the first column without the first value
+      outFile.close();
+   }
    else {
-      for(int i = 0; i < iRead; i+=6){ // decode the ADC values, which 12 bits on 2 bytes (the MSB of the second byte is irrelevant)
-         uint16_t adc0 = (((uint16_t) readBuf[i]) << 4) + (readBuf[i+1] & 0x0F);
-         uint16_t adc1 = (readBuf[i+2] << 4) + (readBuf[i+3] & 0x0F);
-         uint16_t adc2 = (readBuf[i+4] << 4) + (readBuf[i+5] & 0x0F);
-         outFile << std::dec << adc0 << "; " << std::dec << adc1 << "; " << std::dec << adc2 << "\n"; // write the results to the output file
-         if (i >=6){ // the first value read not always reliable
-            res += outToVolt(adc0); 
+      int32_t nFrames = iRead/sampleReadBytes;
+      samples.resize((size_t)nFrames*scan.reads()); // if kept live, decoded up to the last good frame already
+      if (!keepLive) Osci::decodeFrames(readBuf, nFrames, samples.data(), scan.reads());
+      for(int32_t f = 1; f < nFrames; f++){ // the first value read not always reliable
+         res += Osci::outToVolt(samples[(size_t)f*scan.reads()]);
+      }
+
+      if(!decimFactors.empty()){
+         // One file per column, in volts at the decimated rate
+         Osci::ChannelDecimators decim(decimFactors);
+         decim.process(samples.data(), nFrames);
+         for(int c = 0; c < decim.channels(); c++){
+            std::string path = "out_ch" + std::to_string(c) + ".csv";
+            std::ofstream outFile(path);
+            outFile.precision(7);
+            for(double y : decim.out[c]){
+               outFile << Osci::codeToVolt(y) << '\n';
+            }
+            std::cout << path << ": " << decim.out[c].size() << " values, decimated by " << decim.factor(c) << '\n';
          }
-         
+      }
+      if(codec >= 0){
+         auto t0 = std::chrono::steady_clock::now();
+         Osci::CaptureTiming timing;
+         timing.startNs = timeBase.startNs();
+         timing.nsPerFrame = timeBase.nsPerFrame();
+         timing.driftPpm = timeBase.driftPpm(nominalNs);
+         timing.jitterNs = timeBase.jitterNs();
+         Osci::CaptureStatus status;
+         status.packets = lineStatus.packets;
+         status.overruns = lineStatus.overruns;
+         status.errors = lineStatus.errors;
+         size_t written = Osci::writeCapture("out.osc", (uint8_t) codec, samples.data(), nFrames, (uint8_t) scan.reads(),
+                                             &timing, &timeBase.stamps, &status, &overrunFrames);
+         double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+         if(written == 0) std::cout << "Failed to write out.osc\n";
+         else std::cout << "out.osc: " << written << " bytes, " << (double) samples.size()*sizeof(uint16_t)/written
+                        << "x smaller than uint16_t, " << samples.size()*sizeof(uint16_t)/secs/1e6 << " MB/s\n";
       }
    }
-   float avg = res/((iRead)/6.0-1.0);
+   float avg = res/((double)(iRead)/sampleReadBytes-1.0);
    // std::cout << std::dec << ((iRead)/6-1) << " avg\n"; //average removing the first value
    // std::cout << std::hex << avg << " res\n"; //average removing the first value
    std::cout << avg;
-   outFile.close();
+   if (server) server->drain(); // let connected clients receive the tail of the capture
    std::cout << "\nDone\n";
 
    // Clear system
-   free(writeBuf);
-   free(readBuf);
+   Osci::freeBuffer(&writeMem);
+   Osci::freeBuffer(&readMem);
    ftdi_tcioflush(&Ft232::context);
    ftdi_usb_reset(&Ft232::context);
    ftdi_usb_close(&Ft232::context);
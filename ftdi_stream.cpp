@@ -0,0 +1,167 @@
+// Continuous capture through the C++ wrapper (include/libftdi/ftdi.hpp): a block of
+// scan list frames is repeated into one vectored write covering the whole capture,
+// and the samples are read in steps into two buffers, each read in flight while
+// the previous step is decoded. Reports the mean of every column, the frame rate
+// reached and the receive overruns flagged in the status bytes.
+// Usage: ftdi_stream [--frames n] [--scan file] [--serial S]
+
+// Windows:
+//g++ ftdi_stream.cpp include/libftdi/ftdi.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_stream -Wall
+
+// Linux:
+//g++ ftdi_stream.cpp include/libftdi/ftdi.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_stream -Wall
+
+#include <libftdi/ftdi.hpp>
+#include <osci/board.hpp>
+#include <osci/calib.hpp>
+#include <osci/decimate.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+#include <string.h>
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+
+namespace Osci{
+   const unsigned int chunkSize = 0x10000;      // bulk-IN transfer size
+   const unsigned int writeChunkSize = 0x10000; // bulk-OUT transfer size
+   const unsigned int writeQueueDepth = 8;      // bulk-OUT transfers kept in flight
+   const int32_t blockFrames = 256;             // frames per write fragment
+   const int32_t readStepFrames = 4096;         // frames per read, decoded while the next arrive
+}
+
+
+int main(int argc, char *argv[]){
+   int64_t nFrames = 1 << 20;
+   const char* scanPath = NULL;
+   const char* serial = NULL;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--frames") == 0 && a+1 < argc) nFrames = std::stoll(argv[++a]);
+      else if(strcmp(argv[a], "--scan") == 0 && a+1 < argc) scanPath = argv[++a];
+      else if(strcmp(argv[a], "--serial") == 0 && a+1 < argc) serial = argv[++a];
+   }
+   if(nFrames < 1){
+      std::cout << "At least one frame\n";
+      exit(1);
+   }
+
+   // Initialize FTDI chip; the Context closes it when it goes out of scope
+   Ftdi::Context board;
+   if ( board.open(Ft232::vendor, Ft232::product, "", serial != NULL ? serial : "") < 0 ) {
+      std::cout << "Can't open device. Got error\n"
+		<< board.error_string() << '\n';
+      exit(1);
+   }
+   Osci::SpiSetting spi;
+   std::string calib = Osci::calibPath(board.serial());
+   if(Osci::loadCalibration(calib, &spi)){
+      std::cout << "Using " << calib << ": divisor " << spi.divisor << ", " << Osci::edgeName(spi.readEdge) << " edge\n";
+   }
+   board.reset();
+   board.set_bitmode(0, BITMODE_RESET);
+   board.set_bitmode(0, BITMODE_MPSSE); // enable mpsse on all bits
+   board.tcflush();
+   board.set_read_chunk_size(Osci::chunkSize);
+   board.set_write_chunk_size(Osci::writeChunkSize);
+   board.set_write_queue_depth(Osci::writeQueueDepth);
+   board.reserve_transfer_pool(2, Osci::writeQueueDepth + 1);
+
+   // Frames end with their CS release, as no DAC write follows them
+   Osci::ScanList scan = Osci::ScanList::defaults();
+   if(scanPath != NULL && !Osci::ScanList::load(scanPath, &scan)){
+      std::cout << "Can't read scan list " << scanPath << '\n';
+      exit(1);
+   }
+   if(!scan.compile(spi.readEdge, spi.divisor, Osci::setBitsClocks)){
+      std::cout << "Scan list is empty or longer than " << Osci::maxReads << " reads\n";
+      exit(1);
+   }
+   scan.print(std::cout);
+   const int columns = scan.reads();
+   const int32_t sampleReadBytes = columns*Osci::adcReadBytes;
+   const int32_t frameCmdBytes = scan.frameBytes() + Osci::releaseCmdBytes;
+   if(nFrames*frameCmdBytes > INT32_MAX){
+      std::cout << "Capture too long for a single write, lower --frames\n";
+      exit(1);
+   }
+
+   // Setup MPSSE
+   std::vector<uint8_t> setup(Osci::setupCmdBytes);
+   int32_t iWrite = 0;
+   Osci::setupMpsse(setup.data(), &iWrite, spi.divisor);
+   if ( board.write(Ftdi::ConstBytes(setup).subspan(0, iWrite)) != iWrite ) {
+      std::cout << "Write failed\n";
+      exit(1);
+   }
+
+   // One block of frames, sent whole as often as it fits and cut short at the end
+   std::vector<uint8_t> block((size_t)Osci::blockFrames*frameCmdBytes);
+   int32_t iRead = 0;
+   iWrite = 0;
+   for(int32_t f = 0; f < Osci::blockFrames; f++){
+      scan.append(block.data(), &iWrite, &iRead);
+      Osci::releaseCs(block.data(), &iWrite);
+   }
+   std::vector<struct ftdi_iovec> stream((size_t)(nFrames/Osci::blockFrames), {block.data(), (int) block.size()});
+   if(nFrames % Osci::blockFrames != 0){
+      stream.push_back({block.data(), (int) ((nFrames % Osci::blockFrames)*frameCmdBytes)});
+   }
+
+   // Read step k lands in buffer k%2 while step k-1 is decoded from the other
+   std::vector<uint8_t> readBuf[2];
+   for(auto& b : readBuf) b.resize((size_t)Osci::readStepFrames*sampleReadBytes);
+   std::vector<uint16_t> adc((size_t)Osci::readStepFrames*columns);
+   std::vector<double> sum(columns, 0.0);
+   auto t0 = std::chrono::steady_clock::now();
+   board.tcflush(Ftdi::Context::Output);
+   Ftdi::Transfer write = board.writev_async(stream.data(), (int) stream.size());
+   Ftdi::Transfer read;
+   int64_t nRead = 0, nDecoded = 0;
+   int32_t pending = 0; // frames of the read in flight
+   bool failed = false;
+   for(int k = 0; nDecoded < nFrames; k++){
+      int32_t n = 0;
+      if(nRead < nFrames){
+         n = (nFrames - nRead < Osci::readStepFrames) ? (int32_t) (nFrames - nRead) : Osci::readStepFrames;
+         read = board.read_async(Ftdi::Bytes(readBuf[k % 2]).subspan(0, (uint64_t)n*sampleReadBytes));
+         nRead += n;
+      }
+      if(pending > 0){
+         Osci::decodeFrames(readBuf[(k + 1) % 2].data(), pending, adc.data(), columns);
+         for(int32_t f = 0; f < pending; f++){
+            for(int c = 0; c < columns; c++) sum[c] += Osci::adcSigned(adc[(size_t)f*columns + c]);
+         }
+         nDecoded += pending;
+      }
+      pending = n;
+      if(n > 0 && read.get() != (int64_t)n*sampleReadBytes){
+         failed = true;
+         break;
+      }
+   }
+   if(failed) write.cancel(); // still in flight after a failed read
+   int64_t written = failed ? -1 : write.get();
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   if(failed || written != nFrames*frameCmdBytes){
+      std::cout << "Capture failed after " << nDecoded << " of " << nFrames << " frames\n";
+      exit(1);
+   }
+
+   std::cout << nFrames << " frames in " << secs << " s: " << nFrames/secs/1e3 << " kS/s (nominal "
+             << 1e6/(scan.frameClocks()*Osci::skPeriodNs(spi.divisor)) << ")\n";
+   for(int c = 0; c < columns; c++){
+      std::cout << "column " << c << ": mean " << Osci::codeToVolt(sum[c]/nFrames) << " V\n";
+   }
+   struct ftdi_line_status_stats lineStatus = board.line_status_stats();
+   if(lineStatus.overruns > 0){
+      std::cout << lineStatus.overruns << " FIFO overruns, the first at byte " << lineStatus.overrun_pos[0] << '\n';
+   }
+   struct ftdi_transfer_pool_stats pool = board.transfer_pool_stats();
+   std::cout << "transfer pool: " << pool.transfer_misses << " transfer and " << pool.control_misses << " control allocations\n";
+
+   // Clear system
+   board.tcflush();
+   board.reset();
+   return 0;
+}
@@ -1,5 +1,5 @@
 // Windows:
-//g++ ftdi_testGlobal.cpp -I include/ -L include/libftdi -lftdi1 -lftdipp1 -o build/ftdi_testGlobal -Wall
+//g++ ftdi_testGlobal.cpp -x c include/libftdi/ftdi.c -x none -I include/ $(pkg-config --cflags --libs libusb-1.0) -o build/ftdi_testGlobal -Wall
 
 #include <libftdi/ftdi.hpp>
 #include <stdio.h>
@@ -34,6 +34,10 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #include "ftdi_i.h"
 /* Prevent deprecated messages when building library */
@@ -101,9 +105,21 @@ int ftdi_init(struct ftdi_context *ftdi)
     ftdi->bitbang_enabled = 0;  /* 0: normal mode 1: any of the bitbang modes enabled */
 
     ftdi->readbuffer = NULL;
+    ftdi->readbuffer_size = 0;
     ftdi->readbuffer_offset = 0;
     ftdi->readbuffer_remaining = 0;
+    memset(ftdi->buffer_pool, 0, sizeof(ftdi->buffer_pool));
+    memset(ftdi->buffer_pool_size, 0, sizeof(ftdi->buffer_pool_size));
+    ftdi->control_pool = NULL;
+    ftdi->control_pool_count = 0;
+    ftdi->control_pool_max = 0;
+    ftdi->transfer_pool = NULL;
+    ftdi->transfer_pool_count = 0;
+    ftdi->transfer_pool_max = 0;
+    memset(&ftdi->transfer_pool_stats, 0, sizeof(ftdi->transfer_pool_stats));
+    memset(&ftdi->line_status_stats, 0, sizeof(ftdi->line_status_stats));
     ftdi->writebuffer_chunksize = 4096;
+    ftdi->writebuffer_queue_depth = 1;
     ftdi->max_packet_size = 0;
     ftdi->error_str = NULL;
     ftdi->module_detach_mode = AUTO_DETACH_SIO_MODULE;
@@ -120,6 +136,9 @@ int ftdi_init(struct ftdi_context *ftdi)
     memset(eeprom, 0, sizeof(struct ftdi_eeprom));
     ftdi->eeprom = eeprom;
 
+    if (ftdi_transfer_pool_reserve(ftdi, FTDI_TRANSFER_POOL_CONTROLS, FTDI_TRANSFER_POOL_TRANSFERS) < 0)
+        ftdi_error_return(-2, "Can't malloc transfer pool");
+
     /* All fine. Now allocate the readbuffer */
     return ftdi_read_data_set_chunksize(ftdi, 4096);
 }
@@ -206,6 +225,100 @@ int ftdi_set_interface(struct ftdi_context *ftdi, enum ftdi_interface interface)
     return 0;
 }
 
+/* Transfer buffers are page-aligned (hence cache-line aligned) and sized to a
+   multiple of the USB packet size. Released buffers go to a small per-context
+   pool and are handed out again for any request they fit without wasting more
+   than half of them, so changing the chunk size between captures doesn't go
+   back to the allocator. */
+#define FTDI_BUFFER_ALIGN 4096
+
+static unsigned char *ftdi_buffer_alloc(unsigned int size)
+{
+    void *buf;
+#ifdef _WIN32
+    buf = _aligned_malloc(size, FTDI_BUFFER_ALIGN);
+#else
+    if (posix_memalign(&buf, FTDI_BUFFER_ALIGN, size) != 0)
+        buf = NULL;
+#endif
+    return (unsigned char *)buf;
+}
+
+static void ftdi_buffer_release(unsigned char *buf)
+{
+#ifdef _WIN32
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
+
+/* Take a buffer of at least size bytes from the pool or allocate one, its
+   actual size is stored in *got */
+static unsigned char *ftdi_buffer_get(struct ftdi_context *ftdi, unsigned int size, unsigned int *got)
+{
+    unsigned char *buf;
+    int i;
+
+    for (i = 0; i < FTDI_BUFFER_POOL_SIZE; i++)
+    {
+        if (ftdi->buffer_pool[i] != NULL && ftdi->buffer_pool_size[i] >= size
+            && ftdi->buffer_pool_size[i] / 2 <= size)
+        {
+            buf = ftdi->buffer_pool[i];
+            *got = ftdi->buffer_pool_size[i];
+            ftdi->buffer_pool[i] = NULL;
+            ftdi->buffer_pool_size[i] = 0;
+            return buf;
+        }
+    }
+
+    buf = ftdi_buffer_alloc(size);
+    *got = buf ? size : 0;
+    return buf;
+}
+
+/* Return a buffer to the pool, evicting the smallest one when it is full */
+static void ftdi_buffer_put(struct ftdi_context *ftdi, unsigned char *buf, unsigned int size)
+{
+    int i, slot = 0;
+
+    for (i = 0; i < FTDI_BUFFER_POOL_SIZE; i++)
+    {
+        if (ftdi->buffer_pool[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+        if (ftdi->buffer_pool_size[i] < ftdi->buffer_pool_size[slot])
+            slot = i;
+    }
+    if (ftdi->buffer_pool[slot] != NULL)
+    {
+        if (ftdi->buffer_pool_size[slot] >= size)
+        {
+            ftdi_buffer_release(buf);
+            return;
+        }
+        ftdi_buffer_release(ftdi->buffer_pool[slot]);
+    }
+    ftdi->buffer_pool[slot] = buf;
+    ftdi->buffer_pool_size[slot] = size;
+}
+
+static void ftdi_buffer_pool_clear(struct ftdi_context *ftdi)
+{
+    int i;
+
+    for (i = 0; i < FTDI_BUFFER_POOL_SIZE; i++)
+    {
+        if (ftdi->buffer_pool[i] != NULL)
+            ftdi_buffer_release(ftdi->buffer_pool[i]);
+        ftdi->buffer_pool[i] = NULL;
+        ftdi->buffer_pool_size[i] = 0;
+    }
+}
+
 /**
     Deinitializes a ftdi_context.
 
@@ -220,9 +333,12 @@ void ftdi_deinit(struct ftdi_context *ftdi)
 
     if (ftdi->readbuffer != NULL)
     {
-        free(ftdi->readbuffer);
+        ftdi_buffer_put(ftdi, ftdi->readbuffer, ftdi->readbuffer_size);
         ftdi->readbuffer = NULL;
+        ftdi->readbuffer_size = 0;
     }
+    ftdi_buffer_pool_clear(ftdi);
+    ftdi_transfer_pool_reserve(ftdi, 0, 0);
 
     if (ftdi->eeprom != NULL)
     {
@@ -855,6 +971,25 @@ int ftdi_usb_open_desc_index(struct ftdi_context *ftdi, int vendor, int product,
     \retval -12: libusb_get_device_list() failed
 */
 int ftdi_usb_open_bus_addr(struct ftdi_context *ftdi, uint8_t bus, uint8_t addr)
+{
+    return ftdi_usb_open_id_bus_addr(ftdi, -1, -1, bus, addr);
+}
+
+/**
+    Opens the device at a given USB bus and device address if it has the
+    given vendor and product ids. For reopening a device at a remembered
+    address: a different device that got the address meanwhile is left alone.
+
+    \param ftdi pointer to ftdi_context
+    \param vendor Vendor ID, -1 for any
+    \param product Product ID, -1 for any
+    \param bus Bus number
+    \param addr Device address
+
+    \retval same as ftdi_usb_open_bus_addr()
+    \retval -13: libusb_get_device_descriptor() failed
+*/
+int ftdi_usb_open_id_bus_addr(struct ftdi_context *ftdi, int vendor, int product, uint8_t bus, uint8_t addr)
 {
     libusb_device *dev;
     libusb_device **devs;
@@ -870,7 +1005,16 @@ int ftdi_usb_open_bus_addr(struct ftdi_context *ftdi, uint8_t bus, uint8_t addr)
     {
         if (libusb_get_bus_number(dev) == bus && libusb_get_device_address(dev) == addr)
         {
+            struct libusb_device_descriptor desc;
             int res;
+
+            if (vendor >= 0 || product >= 0)
+            {
+                if (libusb_get_device_descriptor(dev, &desc) < 0)
+                    ftdi_error_return_free_device_list(-13, "libusb_get_device_descriptor() failed", devs);
+                if ((vendor >= 0 && desc.idVendor != vendor) || (product >= 0 && desc.idProduct != product))
+                    break;
+            }
             res = ftdi_usb_open_dev(ftdi, dev);
             libusb_free_device_list(devs,1);
             return res;
@@ -881,6 +1025,82 @@ int ftdi_usb_open_bus_addr(struct ftdi_context *ftdi, uint8_t bus, uint8_t addr)
     ftdi_error_return_free_device_list(-3, "device not found", devs);
 }
 
+/**
+    Get the location of the open device: bus number, device address and the
+    path of hub port numbers from the root. Bus and address may change when
+    the device is replugged, the port path only when it moves to another port.
+
+    \param ftdi pointer to ftdi_context
+    \param bus Pointer to store the bus number in, may be NULL
+    \param addr Pointer to store the device address in, may be NULL
+    \param ports Buffer for the port numbers, may be NULL
+    \param ports_len Size of ports
+
+    \retval >=0: number of port numbers stored
+    \retval -1: ftdi context invalid
+    \retval -2: USB device unavailable
+    \retval -3: ports too small
+*/
+int ftdi_usb_get_location(struct ftdi_context *ftdi, uint8_t *bus, uint8_t *addr, uint8_t *ports, int ports_len)
+{
+    libusb_device *dev;
+    int n = 0;
+
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+    if (ftdi->usb_dev == NULL)
+        ftdi_error_return(-2, "USB device unavailable");
+
+    dev = libusb_get_device(ftdi->usb_dev);
+    if (bus != NULL)
+        *bus = libusb_get_bus_number(dev);
+    if (addr != NULL)
+        *addr = libusb_get_device_address(dev);
+    if (ports != NULL)
+    {
+        n = libusb_get_port_numbers(dev, ports, ports_len);
+        if (n < 0)
+            ftdi_error_return(-3, "port path buffer too small");
+    }
+    return n;
+}
+
+/**
+    Read the serial number string of the open device.
+
+    Unlike ftdi_usb_get_strings() this reads a single string descriptor
+    and leaves the device open.
+
+    \param ftdi pointer to ftdi_context
+    \param serial Buffer for the serial number
+    \param serial_len Size of serial
+
+    \retval  0: all fine
+    \retval -1: ftdi context invalid
+    \retval -2: USB device unavailable
+    \retval -3: libusb_get_device_descriptor() failed
+    \retval -4: libusb_get_string_descriptor_ascii() failed
+*/
+int ftdi_usb_get_serial(struct ftdi_context *ftdi, char *serial, int serial_len)
+{
+    struct libusb_device_descriptor desc;
+
+    if (ftdi == NULL || serial == NULL || serial_len <= 0)
+        ftdi_error_return(-1, "ftdi context invalid");
+    if (ftdi->usb_dev == NULL)
+        ftdi_error_return(-2, "USB device unavailable");
+
+    if (libusb_get_device_descriptor(libusb_get_device(ftdi->usb_dev), &desc) < 0)
+        ftdi_error_return(-3, "libusb_get_device_descriptor() failed");
+
+    serial[0] = '\0';
+    if (desc.iSerialNumber != 0
+        && libusb_get_string_descriptor_ascii(ftdi->usb_dev, desc.iSerialNumber, (unsigned char *)serial, serial_len) < 0)
+        ftdi_error_return(-4, "libusb_get_string_descriptor_ascii() failed");
+
+    return 0;
+}
+
 /**
     Opens the ftdi-device described by a description-string.
     Intended to be used for parsing a device-description given as commandline argument.
@@ -1576,6 +1796,9 @@ int ftdi_set_line_property2(struct ftdi_context *ftdi, enum ftdi_bits_type bits,
     \param buf Buffer with the data
     \param size Size of the buffer
 
+    With a queue depth above 1 (see ftdi_write_data_set_queue_depth()) the
+    chunks are queued with ftdi_write_data_submit() and waited for.
+
     \retval -666: USB device unavailable
     \retval <0: error code from usb_bulk_write()
     \retval >0: number of bytes written
@@ -1588,6 +1811,17 @@ int ftdi_write_data(struct ftdi_context *ftdi, const unsigned char *buf, int siz
     if (ftdi == NULL || ftdi->usb_dev == NULL)
         ftdi_error_return(-666, "USB device unavailable");
 
+    if (ftdi->writebuffer_queue_depth > 1 && size > (int)ftdi->writebuffer_chunksize)
+    {
+        struct ftdi_transfer_control *tc = ftdi_write_data_submit(ftdi, (unsigned char *)buf, size);
+        if (tc == NULL)
+            ftdi_error_return(-1, "usb bulk write submit failed");
+        offset = ftdi_transfer_data_done(tc);
+        if (offset < 0)
+            ftdi_error_return(-1, "usb bulk write failed");
+        return offset;
+    }
+
     while (offset < size)
     {
         int write_size = ftdi->writebuffer_chunksize;
@@ -1604,6 +1838,160 @@ int ftdi_write_data(struct ftdi_context *ftdi, const unsigned char *buf, int siz
     return offset;
 }
 
+/* Transfer controls and libusb transfers are recycled through per-context free
+   pools instead of being allocated and freed around every submission. When a
+   pool runs dry the allocator fills in and the miss is counted. */
+
+static struct libusb_transfer *ftdi_transfer_get(struct ftdi_context *ftdi)
+{
+    struct ftdi_transfer_pool_stats *stats = &ftdi->transfer_pool_stats;
+    struct libusb_transfer *transfer;
+
+    if (ftdi->transfer_pool_count > 0)
+    {
+        transfer = ftdi->transfer_pool[--ftdi->transfer_pool_count];
+        transfer->flags = 0;
+        stats->transfer_hits++;
+    }
+    else
+    {
+        transfer = libusb_alloc_transfer(0);
+        if (!transfer)
+            return NULL;
+        stats->transfer_misses++;
+    }
+
+    if (++stats->transfers_in_use > stats->transfers_peak)
+        stats->transfers_peak = stats->transfers_in_use;
+    return transfer;
+}
+
+static void ftdi_transfer_put(struct ftdi_context *ftdi, struct libusb_transfer *transfer)
+{
+    struct ftdi_transfer_pool_stats *stats = &ftdi->transfer_pool_stats;
+
+    stats->transfers_in_use--;
+    if (ftdi->transfer_pool_count < ftdi->transfer_pool_max)
+        ftdi->transfer_pool[ftdi->transfer_pool_count++] = transfer;
+    else
+    {
+        libusb_free_transfer(transfer);
+        stats->transfer_overflows++;
+    }
+}
+
+/* Return a transfer control and all of its transfers to the pools */
+static void ftdi_transfer_control_free(struct ftdi_transfer_control *tc)
+{
+    struct ftdi_context *ftdi = tc->ftdi;
+    int i;
+
+    for (i = 0; i < tc->num_transfers; i++)
+        if (tc->transfers[i])
+            ftdi_transfer_put(ftdi, tc->transfers[i]);
+
+    ftdi->transfer_pool_stats.controls_in_use--;
+    if (ftdi->control_pool_count < ftdi->control_pool_max)
+    {
+        tc->next_free = ftdi->control_pool;
+        ftdi->control_pool = tc;
+        ftdi->control_pool_count++;
+    }
+    else
+    {
+        free(tc->transfer_array);
+        free(tc->stage);
+        free(tc);
+        ftdi->transfer_pool_stats.control_overflows++;
+    }
+}
+
+/* Take a transfer control with room for num_transfers transfers, all NULL */
+static struct ftdi_transfer_control *ftdi_transfer_control_get(struct ftdi_context *ftdi, int num_transfers)
+{
+    struct ftdi_transfer_pool_stats *stats = &ftdi->transfer_pool_stats;
+    struct ftdi_transfer_control *tc;
+
+    if (ftdi->control_pool != NULL)
+    {
+        tc = ftdi->control_pool;
+        ftdi->control_pool = tc->next_free;
+        ftdi->control_pool_count--;
+        stats->control_hits++;
+    }
+    else
+    {
+        tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
+        if (!tc)
+            return NULL;
+        tc->transfer_array = NULL;
+        tc->transfer_array_size = 0;
+        tc->stage = NULL;
+        tc->stage_size = 0;
+        stats->control_misses++;
+    }
+    if (++stats->controls_in_use > stats->controls_peak)
+        stats->controls_peak = stats->controls_in_use;
+
+    tc->ftdi = ftdi;
+    tc->transfer = NULL;
+    tc->iov = NULL;
+    tc->num_transfers = num_transfers;
+    if (num_transfers == 1)
+        tc->transfers = &tc->transfer;
+    else
+    {
+        if (tc->transfer_array_size < num_transfers)
+        {
+            struct libusb_transfer **array = (struct libusb_transfer **)
+                realloc (tc->transfer_array, num_transfers * sizeof (*array));
+            if (!array)
+            {
+                tc->transfers = &tc->transfer;
+                tc->num_transfers = 1;
+                ftdi_transfer_control_free(tc);
+                return NULL;
+            }
+            tc->transfer_array = array;
+            tc->transfer_array_size = num_transfers;
+        }
+        memset(tc->transfer_array, 0, num_transfers * sizeof (*tc->transfer_array));
+        tc->transfers = tc->transfer_array;
+    }
+    return tc;
+}
+
+/* Tally the two status bytes heading each packet of a raw read before they
+   are stripped: one byte test per packet, the payload offsets of the first
+   overruns kept. */
+static void ftdi_parse_status(struct ftdi_context *ftdi, const unsigned char *buf, int length)
+{
+    struct ftdi_line_status_stats *stats = &ftdi->line_status_stats;
+    int packet_size = ftdi->max_packet_size;
+    int pos;
+
+    for (pos = 0; pos + 2 <= length; pos += packet_size)
+    {
+        int payload = length - pos - 2;
+        unsigned char line = buf[pos + 1];
+
+        if (payload > packet_size - 2)
+            payload = packet_size - 2;
+        if (line & FTDI_LS_OE)
+        {
+            if (stats->overruns < FTDI_OVERRUN_POSITIONS)
+                stats->overrun_pos[stats->overruns] = stats->bytes;
+            stats->overruns++;
+        }
+        if (line & (FTDI_LS_PE | FTDI_LS_FE | FTDI_LS_BI | FTDI_LS_ERR))
+            stats->errors++;
+        stats->packets++;
+        stats->bytes += payload;
+        stats->modem_status = buf[pos];
+        stats->line_status = line;
+    }
+}
+
 static void LIBUSB_CALL ftdi_read_data_cb(struct libusb_transfer *transfer)
 {
     struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
@@ -1613,11 +2001,11 @@ static void LIBUSB_CALL ftdi_read_data_cb(struct libusb_transfer *transfer)
     packet_size = ftdi->max_packet_size;
 
     actual_length = transfer->actual_length;
+    ftdi_parse_status(ftdi, ftdi->readbuffer+ftdi->readbuffer_offset, actual_length);
 
     if (actual_length > 2)
     {
-        // skip FTDI status bytes.
-        // Maybe stored in the future to enable modem use
+        // skip FTDI status bytes, tallied above
         num_of_chunks = actual_length / packet_size;
         chunk_remains = actual_length % packet_size;
         //printf("actual_length = %X, num_of_chunks = %X, chunk_remains = %X, readbuffer_offset = %X\n", actual_length, num_of_chunks, chunk_remains, ftdi->readbuffer_offset);
@@ -1692,12 +2080,103 @@ static void LIBUSB_CALL ftdi_read_data_cb(struct libusb_transfer *transfer)
 }
 
 
+/* Point a queued write transfer at its next chunk: in the caller's buffer, in
+   the fragment when a vectored chunk lies within one, else gathered into the
+   transfer's slot of the staging area. Returns the chunk size. */
+static int ftdi_write_fill(struct ftdi_transfer_control *tc, struct libusb_transfer *transfer, int slot)
+{
+    int write_size = tc->chunksize;
+
+    if (tc->submitted + write_size > tc->size)
+        write_size = tc->size - tc->submitted;
+
+    if (tc->iov == NULL)
+        transfer->buffer = tc->buf + tc->submitted;
+    else if (write_size == 0)
+        transfer->buffer = tc->stage; /* only empty fragments: nothing to point into */
+    else
+    {
+        const struct ftdi_iovec *iov;
+
+        /* Skip finished and empty fragments */
+        while (tc->iov_index < tc->iovcnt && tc->iov_offset == tc->iov[tc->iov_index].len)
+        {
+            tc->iov_index++;
+            tc->iov_offset = 0;
+        }
+        iov = &tc->iov[tc->iov_index];
+
+        if (iov->len - tc->iov_offset >= write_size)
+        {
+            transfer->buffer = (unsigned char *)iov->base + tc->iov_offset;
+            tc->iov_offset += write_size;
+        }
+        else
+        {
+            unsigned char *stage = tc->stage + slot * tc->chunksize;
+            int filled = 0;
+
+            while (filled < write_size)
+            {
+                int n = tc->iov[tc->iov_index].len - tc->iov_offset;
+
+                if (n > write_size - filled)
+                    n = write_size - filled;
+                memcpy(stage + filled, tc->iov[tc->iov_index].base + tc->iov_offset, n);
+                filled += n;
+                tc->iov_offset += n;
+                if (tc->iov_offset == tc->iov[tc->iov_index].len)
+                {
+                    tc->iov_index++;
+                    tc->iov_offset = 0;
+                }
+            }
+            transfer->buffer = stage;
+        }
+    }
+
+    transfer->length = write_size;
+    return write_size;
+}
+
 static void LIBUSB_CALL ftdi_write_data_cb(struct libusb_transfer *transfer)
 {
     struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
     struct ftdi_context *ftdi = tc->ftdi;
 
     tc->offset += transfer->actual_length;
+    tc->in_flight--;
+
+    if (tc->num_transfers > 1 || tc->iov != NULL)
+    {
+        /* Queued write: chunks were handed out in order, so a short or failed
+           chunk can't be resent without reordering. Stop refilling and let
+           the transfers still in flight drain. */
+        if (transfer->status != LIBUSB_TRANSFER_COMPLETED
+            || transfer->actual_length != transfer->length)
+            tc->submitted = tc->size;
+
+        if (tc->submitted < tc->size)
+        {
+            int slot = 0, write_size;
+
+            while (tc->transfers[slot] != transfer)
+                slot++;
+            write_size = ftdi_write_fill(tc, transfer, slot);
+
+            if (libusb_submit_transfer (transfer) < 0)
+                tc->submitted = tc->size;
+            else
+            {
+                tc->submitted += write_size;
+                tc->in_flight++;
+            }
+        }
+
+        if (tc->in_flight == 0)
+            tc->completed = (transfer->status == LIBUSB_TRANSFER_CANCELLED) ? LIBUSB_TRANSFER_CANCELLED : 1;
+        return;
+    }
 
     if (tc->offset == tc->size)
     {
@@ -1721,17 +2200,115 @@ static void LIBUSB_CALL ftdi_write_data_cb(struct libusb_transfer *transfer)
             ret = libusb_submit_transfer (transfer);
             if (ret < 0)
                 tc->completed = 1;
+            else
+                tc->in_flight++;
         }
     }
 }
 
 
+/* Queue a write from buf, or from the fragments in iov when it isn't NULL */
+static struct ftdi_transfer_control *ftdi_write_submit(struct ftdi_context *ftdi, unsigned char *buf,
+                                                       const struct ftdi_iovec *iov, int iovcnt, int size)
+{
+    struct ftdi_transfer_control *tc;
+    int chunks, num_transfers, i;
+
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        return NULL;
+
+    chunks = (size + ftdi->writebuffer_chunksize - 1) / ftdi->writebuffer_chunksize;
+    num_transfers = ftdi->writebuffer_queue_depth;
+    if (num_transfers > chunks)
+        num_transfers = chunks;
+    if (num_transfers < 1)
+        num_transfers = 1;
+
+    tc = ftdi_transfer_control_get(ftdi, num_transfers);
+    if (!tc)
+        return NULL;
+
+    tc->completed = 0;
+    tc->buf = buf;
+    tc->size = size;
+    tc->offset = 0;
+    tc->submitted = 0;
+    tc->in_flight = 0;
+    tc->chunksize = ftdi->writebuffer_chunksize;
+
+    if (iov != NULL)
+    {
+        int stage_size = num_transfers * tc->chunksize;
+
+        if (tc->stage_size < stage_size)
+        {
+            unsigned char *stage = (unsigned char *) realloc (tc->stage, stage_size);
+            if (!stage)
+            {
+                ftdi_transfer_control_free(tc);
+                return NULL;
+            }
+            tc->stage = stage;
+            tc->stage_size = stage_size;
+        }
+        tc->iov = iov;
+        tc->iovcnt = iovcnt;
+        tc->iov_index = 0;
+        tc->iov_offset = 0;
+    }
+
+    for (i = 0; i < num_transfers; i++)
+    {
+        struct libusb_transfer *transfer = ftdi_transfer_get(ftdi);
+        int write_size;
+
+        if (!transfer)
+            break;
+        tc->transfers[i] = transfer;
+
+        libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->in_ep, NULL,
+                                  0, ftdi_write_data_cb, tc,
+                                  ftdi->usb_write_timeout);
+        transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+        write_size = ftdi_write_fill(tc, transfer, i);
+
+        if (libusb_submit_transfer(transfer) < 0)
+        {
+            /* Keep only the submitted transfers, so completion doesn't look
+               at the status of one that never ran */
+            ftdi_transfer_put(ftdi, transfer);
+            tc->transfers[i] = NULL;
+            break;
+        }
+        tc->submitted += write_size;
+        tc->in_flight++;
+    }
+    tc->transfer = tc->transfers[0];
+
+    if (i < num_transfers)
+    {
+        if (tc->in_flight == 0)
+        {
+            ftdi_transfer_control_free(tc);
+            return NULL;
+        }
+        /* Go on with the transfers that made it */
+        tc->submitted = size;
+    }
+
+    return tc;
+}
+
 /**
     Writes data to the chip. Does not wait for completion of the transfer
     nor does it make sure that the transfer was successful.
 
     Use libusb 1.0 asynchronous API.
 
+    Up to the queue depth (see ftdi_write_data_set_queue_depth()) chunks are
+    kept in flight, each completed transfer being refilled with the next
+    chunk, so the chip's receive FIFO doesn't drain between chunks.
+
     \param ftdi pointer to ftdi_context
     \param buf Buffer with the data
     \param size Size of the buffer
@@ -1741,51 +2318,71 @@ static void LIBUSB_CALL ftdi_write_data_cb(struct libusb_transfer *transfer)
 */
 
 struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    return ftdi_write_submit(ftdi, buf, NULL, 0, size);
+}
+
+/**
+    Writes a list of buffer fragments to the chip as one stream, without
+    copying them into a contiguous buffer first. Waits for completion.
+
+    The fragments are cut into chunks (see ftdi_write_data_set_chunksize())
+    and queued like ftdi_write_data_submit() does. A chunk that lies within
+    one fragment is sent from it directly; one spanning fragments is gathered
+    into a chunk-sized staging area. The same fragment, such as a fixed
+    command block, may appear any number of times.
+
+    \param ftdi pointer to ftdi_context
+    \param iov Fragments, in order
+    \param iovcnt Number of fragments, at least 1
+
+    \retval -666: USB device unavailable
+    \retval -1: usb bulk write failed
+    \retval >=0: number of bytes written
+*/
+int ftdi_write_datav(struct ftdi_context *ftdi, const struct ftdi_iovec *iov, int iovcnt)
 {
     struct ftdi_transfer_control *tc;
-    struct libusb_transfer *transfer;
-    int write_size, ret;
+    int ret;
 
     if (ftdi == NULL || ftdi->usb_dev == NULL)
-        return NULL;
-
-    tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
-    if (!tc)
-        return NULL;
+        ftdi_error_return(-666, "USB device unavailable");
 
-    transfer = libusb_alloc_transfer(0);
-    if (!transfer)
-    {
-        free(tc);
-        return NULL;
-    }
+    tc = ftdi_write_datav_submit(ftdi, iov, iovcnt);
+    if (tc == NULL)
+        ftdi_error_return(-1, "usb bulk write submit failed");
+    ret = ftdi_transfer_data_done(tc);
+    if (ret < 0)
+        ftdi_error_return(-1, "usb bulk write failed");
+    return ret;
+}
 
-    tc->ftdi = ftdi;
-    tc->completed = 0;
-    tc->buf = buf;
-    tc->size = size;
-    tc->offset = 0;
+/**
+    Writes a list of buffer fragments to the chip, see ftdi_write_datav().
+    Does not wait for completion of the transfer nor does it make sure that
+    the transfer was successful. The fragment list and the fragments must
+    stay valid until ftdi_transfer_data_done().
 
-    if (size < (int)ftdi->writebuffer_chunksize)
-        write_size = size;
-    else
-        write_size = ftdi->writebuffer_chunksize;
+    \param ftdi pointer to ftdi_context
+    \param iov Fragments, in order
+    \param iovcnt Number of fragments, at least 1
 
-    libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->in_ep, buf,
-                              write_size, ftdi_write_data_cb, tc,
-                              ftdi->usb_write_timeout);
-    transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+    \retval NULL: Some error happens when submit transfer, or no fragments
+    \retval !NULL: Pointer to a ftdi_transfer_control
+*/
+struct ftdi_transfer_control *ftdi_write_datav_submit(struct ftdi_context *ftdi, const struct ftdi_iovec *iov, int iovcnt)
+{
+    int size = 0, i;
 
-    ret = libusb_submit_transfer(transfer);
-    if (ret < 0)
-    {
-        libusb_free_transfer(transfer);
-        free(tc);
+    if (iov == NULL || iovcnt <= 0)
         return NULL;
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len < 0 || iov[i].len > INT_MAX - size)
+            return NULL;
+        size += iov[i].len;
     }
-    tc->transfer = transfer;
-
-    return tc;
+    return ftdi_write_submit(ftdi, NULL, iov, iovcnt, size);
 }
 
 /**
@@ -1811,11 +2408,10 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     if (ftdi == NULL || ftdi->usb_dev == NULL)
         return NULL;
 
-    tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
+    tc = ftdi_transfer_control_get(ftdi, 1);
     if (!tc)
         return NULL;
 
-    tc->ftdi = ftdi;
     tc->buf = buf;
     tc->size = size;
 
@@ -1831,7 +2427,7 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
 
         tc->completed = 1;
         tc->offset = size;
-        tc->transfer = NULL;
+        tc->in_flight = 0;
         return tc;
     }
 
@@ -1845,12 +2441,13 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     else
         tc->offset = 0;
 
-    transfer = libusb_alloc_transfer(0);
+    transfer = ftdi_transfer_get(ftdi);
     if (!transfer)
     {
-        free (tc);
+        ftdi_transfer_control_free(tc);
         return NULL;
     }
+    tc->transfer = transfer;
 
     ftdi->readbuffer_remaining = 0;
     ftdi->readbuffer_offset = 0;
@@ -1861,11 +2458,10 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     ret = libusb_submit_transfer(transfer);
     if (ret < 0)
     {
-        libusb_free_transfer(transfer);
-        free (tc);
+        ftdi_transfer_control_free(tc);
         return NULL;
     }
-    tc->transfer = transfer;
+    tc->in_flight = 1;
 
     return tc;
 }
@@ -1883,7 +2479,7 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
 
 int ftdi_transfer_data_done(struct ftdi_transfer_control *tc)
 {
-    int ret;
+    int ret, i;
     struct timeval to = { 0, 0 };
     while (!tc->completed)
     {
@@ -1893,13 +2489,14 @@ int ftdi_transfer_data_done(struct ftdi_transfer_control *tc)
         {
             if (ret == LIBUSB_ERROR_INTERRUPTED)
                 continue;
-            libusb_cancel_transfer(tc->transfer);
+            for (i = 0; i < tc->num_transfers; i++)
+                if (tc->transfers[i])
+                    libusb_cancel_transfer(tc->transfers[i]);
             while (!tc->completed)
                 if (libusb_handle_events_timeout_completed(tc->ftdi->usb_ctx,
                         &to, &tc->completed) < 0)
                     break;
-            libusb_free_transfer(tc->transfer);
-            free (tc);
+            ftdi_transfer_control_free(tc);
             return ret;
         }
     }
@@ -1909,13 +2506,14 @@ int ftdi_transfer_data_done(struct ftdi_transfer_control *tc)
      * tc->transfer could be NULL if "(size <= ftdi->readbuffer_remaining)"
      * at ftdi_read_data_submit(). Therefore, we need to check it here.
      **/
-    if (tc->transfer)
+    for (i = 0; i < tc->num_transfers; i++)
     {
-        if (tc->transfer->status != LIBUSB_TRANSFER_COMPLETED)
+        if (tc->transfers[i] && tc->transfers[i]->status != LIBUSB_TRANSFER_COMPLETED)
             ret = -1;
-        libusb_free_transfer(tc->transfer);
     }
-    free(tc);
+    if ((tc->num_transfers > 1 || tc->iov != NULL) && tc->offset != tc->size)
+        ret = -1;
+    ftdi_transfer_control_free(tc);
     return ret;
 }
 
@@ -1932,13 +2530,16 @@ void ftdi_transfer_data_cancel(struct ftdi_transfer_control *tc,
                                struct timeval * to)
 {
     struct timeval tv = { 0, 0 };
+    int i;
 
     if (!tc->completed && tc->transfer != NULL)
     {
         if (to == NULL)
             to = &tv;
 
-        libusb_cancel_transfer(tc->transfer);
+        for (i = 0; i < tc->num_transfers; i++)
+            if (tc->transfers[i])
+                libusb_cancel_transfer(tc->transfers[i]);
         while (!tc->completed)
         {
             if (libusb_handle_events_timeout_completed(tc->ftdi->usb_ctx, to, &tc->completed) < 0)
@@ -1946,10 +2547,108 @@ void ftdi_transfer_data_cancel(struct ftdi_transfer_control *tc,
         }
     }
 
-    if (tc->transfer)
-        libusb_free_transfer(tc->transfer);
+    ftdi_transfer_control_free(tc);
+}
+
+/**
+    Set the transfer pool capacity and preallocate it.
+
+    Each submit takes a transfer control and its libusb transfers (up to the
+    write queue depth for a write) from the context's pools, and
+    ftdi_transfer_data_done() or ftdi_transfer_data_cancel() puts them back.
+    When a pool is exhausted the objects are allocated on the spot and counted
+    as misses by ftdi_transfer_pool_get_stats(); reserve what the application
+    keeps in flight to stay off the allocator. ftdi_init() reserves
+    FTDI_TRANSFER_POOL_CONTROLS and FTDI_TRANSFER_POOL_TRANSFERS.
+
+    \param ftdi pointer to ftdi_context
+    \param controls number of transfer controls to keep
+    \param transfers number of libusb transfers to keep
 
-    free (tc);
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+    \retval -2: out of memory
+*/
+int ftdi_transfer_pool_reserve(struct ftdi_context *ftdi, unsigned int controls, unsigned int transfers)
+{
+    struct ftdi_transfer_control *tc;
+    struct libusb_transfer *transfer;
+
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    while (ftdi->control_pool_count > controls)
+    {
+        tc = ftdi->control_pool;
+        ftdi->control_pool = tc->next_free;
+        ftdi->control_pool_count--;
+        free(tc->transfer_array);
+        free(tc->stage);
+        free(tc);
+    }
+    while (ftdi->transfer_pool_count > transfers)
+        libusb_free_transfer(ftdi->transfer_pool[--ftdi->transfer_pool_count]);
+
+    if (transfers != ftdi->transfer_pool_max)
+    {
+        struct libusb_transfer **pool = NULL;
+
+        if (transfers > 0)
+        {
+            pool = (struct libusb_transfer **) realloc (ftdi->transfer_pool, transfers * sizeof (*pool));
+            if (!pool)
+                ftdi_error_return(-2, "out of memory for transfer pool");
+        }
+        else
+            free(ftdi->transfer_pool);
+        ftdi->transfer_pool = pool;
+        ftdi->transfer_pool_max = transfers;
+    }
+    ftdi->control_pool_max = controls;
+
+    while (ftdi->control_pool_count < controls)
+    {
+        tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
+        if (!tc)
+            ftdi_error_return(-2, "out of memory for transfer pool");
+        tc->transfer_array = NULL;
+        tc->transfer_array_size = 0;
+        tc->stage = NULL;
+        tc->stage_size = 0;
+        tc->next_free = ftdi->control_pool;
+        ftdi->control_pool = tc;
+        ftdi->control_pool_count++;
+    }
+    while (ftdi->transfer_pool_count < transfers)
+    {
+        transfer = libusb_alloc_transfer(0);
+        if (!transfer)
+            ftdi_error_return(-2, "out of memory for transfer pool");
+        ftdi->transfer_pool[ftdi->transfer_pool_count++] = transfer;
+    }
+
+    return 0;
+}
+
+/**
+    Get transfer pool usage since ftdi_init().
+
+    Nonzero misses mean more transfers were in flight than the pool held,
+    see ftdi_transfer_pool_reserve().
+
+    \param ftdi pointer to ftdi_context
+    \param stats Pointer to store the counters in
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_transfer_pool_get_stats(struct ftdi_context *ftdi, struct ftdi_transfer_pool_stats *stats)
+{
+    if (ftdi == NULL || stats == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    *stats = ftdi->transfer_pool_stats;
+    return 0;
 }
 
 /**
@@ -1989,6 +2688,50 @@ int ftdi_write_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunk
     return 0;
 }
 
+/**
+    Configure the number of write chunks ftdi_write_data_submit() keeps in
+    flight. Default is 1, one chunk at a time.
+
+    With several chunks queued the host always has the next one ready when a
+    transfer completes, so the chip's receive FIFO doesn't drain in between.
+
+    \param ftdi pointer to ftdi_context
+    \param depth Number of transfers in flight, at least 1
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+    \retval -2: invalid depth
+*/
+int ftdi_write_data_set_queue_depth(struct ftdi_context *ftdi, unsigned int depth)
+{
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    if (depth < 1)
+        ftdi_error_return(-2, "queue depth must be at least 1");
+
+    ftdi->writebuffer_queue_depth = depth;
+    return 0;
+}
+
+/**
+    Get the number of write chunks kept in flight.
+
+    \param ftdi pointer to ftdi_context
+    \param depth Pointer to store the queue depth in
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_write_data_get_queue_depth(struct ftdi_context *ftdi, unsigned int *depth)
+{
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    *depth = ftdi->writebuffer_queue_depth;
+    return 0;
+}
+
 /**
     Reads data in chunks (see ftdi_read_data_set_chunksize()) from the chip.
 
@@ -2048,11 +2791,11 @@ int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
         ret = libusb_bulk_transfer (ftdi->usb_dev, ftdi->out_ep, ftdi->readbuffer, ftdi->readbuffer_chunksize, &actual_length, ftdi->usb_read_timeout);
         if (ret < 0)
             ftdi_error_return(ret, "usb bulk read failed");
+        ftdi_parse_status(ftdi, ftdi->readbuffer, actual_length);
 
         if (actual_length > 2)
         {
-            // skip FTDI status bytes.
-            // Maybe stored in the future to enable modem use
+            // skip FTDI status bytes, tallied above
             num_of_chunks = actual_length / packet_size;
             chunk_remains = actual_length % packet_size;
             //printf("actual_length = %X, num_of_chunks = %X, chunk_remains = %X, readbuffer_offset = %X\n", actual_length, num_of_chunks, chunk_remains, ftdi->readbuffer_offset);
@@ -2122,7 +2865,10 @@ int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
     Configure read buffer chunk size.
     Default is 4096.
 
-    Automatically reallocates the buffer.
+    The chunk size is rounded up to a multiple of the USB packet size and
+    capped (16384 on Linux, FTDI_MAX_READ_CHUNKSIZE elsewhere): larger bulk
+    transfers are split by the host stack anyway. The buffer is kept if it
+    fits, else taken from the context's buffer pool.
 
     \param ftdi pointer to ftdi_context
     \param chunksize Chunk size
@@ -2133,6 +2879,8 @@ int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
 int ftdi_read_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize)
 {
     unsigned char *new_buf;
+    unsigned int new_size;
+    unsigned int packet_size;
 
     if (ftdi == NULL)
         ftdi_error_return(-1, "ftdi context invalid");
@@ -2147,12 +2895,27 @@ int ftdi_read_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksi
        older than 2.6.32.  */
     if (chunksize > 16384)
         chunksize = 16384;
+#else
+    if (chunksize > FTDI_MAX_READ_CHUNKSIZE)
+        chunksize = FTDI_MAX_READ_CHUNKSIZE;
 #endif
 
-    if ((new_buf = (unsigned char *)realloc(ftdi->readbuffer, chunksize)) == NULL)
-        ftdi_error_return(-1, "out of memory for readbuffer");
+    /* Before the device is opened assume high speed, which is a multiple of full speed */
+    packet_size = ftdi->max_packet_size ? ftdi->max_packet_size : 512;
+    if (chunksize < packet_size)
+        chunksize = packet_size;
+    chunksize = (chunksize + packet_size - 1) / packet_size * packet_size;
 
-    ftdi->readbuffer = new_buf;
+    if (ftdi->readbuffer == NULL || ftdi->readbuffer_size < chunksize || ftdi->readbuffer_size / 2 > chunksize)
+    {
+        if ((new_buf = ftdi_buffer_get(ftdi, chunksize, &new_size)) == NULL)
+            ftdi_error_return(-1, "out of memory for readbuffer");
+
+        if (ftdi->readbuffer != NULL)
+            ftdi_buffer_put(ftdi, ftdi->readbuffer, ftdi->readbuffer_size);
+        ftdi->readbuffer = new_buf;
+        ftdi->readbuffer_size = new_size;
+    }
     ftdi->readbuffer_chunksize = chunksize;
 
     return 0;
@@ -2359,6 +3122,49 @@ int ftdi_poll_modem_status(struct ftdi_context *ftdi, unsigned short *status)
     return 0;
 }
 
+/**
+    Get the status bytes seen on reads since ftdi_init() or the last
+    ftdi_reset_line_status_stats().
+
+    Every USB packet read starts with the modem and line status (see
+    ftdi_poll_modem_status() for their layout). The read calls strip them
+    and count the packets flagging a receive overrun (data lost in the chip
+    because the host did not read fast enough) or a line error, with the
+    payload offsets of the first FTDI_OVERRUN_POSITIONS overruns. The offset
+    counts the bytes received, including any still in the read buffer.
+
+    \param ftdi pointer to ftdi_context
+    \param stats Pointer to store the counters in
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_get_line_status_stats(struct ftdi_context *ftdi, struct ftdi_line_status_stats *stats)
+{
+    if (ftdi == NULL || stats == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    *stats = ftdi->line_status_stats;
+    return 0;
+}
+
+/**
+    Clear the read status counters, e.g. at the start of a capture.
+
+    \param ftdi pointer to ftdi_context
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_reset_line_status_stats(struct ftdi_context *ftdi)
+{
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    memset(&ftdi->line_status_stats, 0, sizeof(ftdi->line_status_stats));
+    return 0;
+}
+
 /**
     Set flowcontrol for ftdi chip
 
@@ -27,6 +27,8 @@ This exception does not invalidate any other reasons why a work based
 on this file might be covered by the GNU General Public License.
 */
 #include <libusb.h>
+#include <limits.h>
+#include <utility>
 #define _FTDI_DISABLE_DEPRECATED
 #include "ftdi.hpp"
 #include "ftdi_i.h"
@@ -35,6 +37,74 @@ on this file might be covered by the GNU General Public License.
 namespace Ftdi
 {
 
+/* Largest piece handed to the C API, which counts bytes in an int */
+static const int max_io_size = 0x40000000;
+
+Transfer::Transfer()
+        : tc(0), result(0), pending(false)
+{
+}
+
+Transfer::Transfer(struct ftdi_transfer_control *tc, int64_t result)
+        : tc(tc), result(result), pending(true)
+{
+}
+
+Transfer::Transfer(Transfer&& other)
+        : tc(other.tc), result(other.result), pending(other.pending)
+{
+    other.tc = 0;
+    other.pending = false;
+}
+
+Transfer& Transfer::operator=(Transfer&& other)
+{
+    if (this != &other)
+    {
+        cancel();
+        tc = other.tc;
+        result = other.result;
+        pending = other.pending;
+        other.tc = 0;
+        other.pending = false;
+    }
+    return *this;
+}
+
+/*! \brief Destructor, cancels a transfer whose result was never taken.
+ */
+Transfer::~Transfer()
+{
+    cancel();
+}
+
+bool Transfer::valid() const
+{
+    return pending;
+}
+
+int64_t Transfer::get()
+{
+    if (!pending)
+        return -1;
+
+    if (tc != 0)
+    {
+        result = ftdi_transfer_data_done(tc);
+        tc = 0;
+    }
+    pending = false;
+    return result;
+}
+
+void Transfer::cancel()
+{
+    if (tc != 0)
+        ftdi_transfer_data_cancel(tc, NULL);
+    tc = 0;
+    pending = false;
+}
+
 class Context::Private
 {
 public:
@@ -75,6 +145,9 @@ Context::~Context()
 {
 }
 
+Context::Context(Context&& other) = default;
+Context& Context::operator=(Context&& other) = default;
+
 bool Context::is_open()
 {
     return d->open;
@@ -279,6 +352,135 @@ int Context::write_chunk_size()
     return chunk;
 }
 
+int Context::set_write_queue_depth(unsigned int depth)
+{
+    return ftdi_write_data_set_queue_depth(d->ftdi, depth);
+}
+
+int Context::write_queue_depth()
+{
+    unsigned depth = 0;
+    if (ftdi_write_data_get_queue_depth(d->ftdi, &depth) < 0)
+        return -1;
+
+    return depth;
+}
+
+int Context::reserve_transfer_pool(unsigned int controls, unsigned int transfers)
+{
+    return ftdi_transfer_pool_reserve(d->ftdi, controls, transfers);
+}
+
+struct ftdi_transfer_pool_stats Context::transfer_pool_stats()
+{
+    struct ftdi_transfer_pool_stats stats = ftdi_transfer_pool_stats();
+    ftdi_transfer_pool_get_stats(d->ftdi, &stats);
+    return stats;
+}
+
+struct ftdi_line_status_stats Context::line_status_stats()
+{
+    struct ftdi_line_status_stats stats = ftdi_line_status_stats();
+    ftdi_get_line_status_stats(d->ftdi, &stats);
+    return stats;
+}
+
+int Context::reset_line_status_stats()
+{
+    return ftdi_reset_line_status_stats(d->ftdi);
+}
+
+/*! \brief Read up to buf.size() bytes.
+ * Stops at the first call that returns less than asked for, like read().
+ * \return bytes read or < 0 on error
+ */
+int64_t Context::read(Bytes buf)
+{
+    uint64_t done = 0;
+
+    while (done < buf.size())
+    {
+        int piece = buf.size() - done < (uint64_t)max_io_size ? (int)(buf.size() - done) : max_io_size;
+        int ret = ftdi_read_data(d->ftdi, buf.data() + done, piece);
+        if (ret < 0)
+            return ret;
+
+        done += ret;
+        if (ret < piece)
+            break;
+    }
+    return done;
+}
+
+/*! \brief Write all of buf.
+ * \return bytes written or < 0 on error
+ */
+int64_t Context::write(ConstBytes buf)
+{
+    uint64_t done = 0;
+
+    while (done < buf.size())
+    {
+        int piece = buf.size() - done < (uint64_t)max_io_size ? (int)(buf.size() - done) : max_io_size;
+        int ret = ftdi_write_data(d->ftdi, buf.data() + done, piece);
+        if (ret < 0)
+            return ret;
+
+        done += ret;
+        if (ret < piece)
+            break;
+    }
+    return done;
+}
+
+/*! \brief Write a list of fragments as one stream, see ftdi_write_datav().
+ * \return bytes written or < 0 on error
+ */
+int Context::writev(const struct ftdi_iovec *iov, int iovcnt)
+{
+    return ftdi_write_datav(d->ftdi, iov, iovcnt);
+}
+
+/*! \brief Start reading up to buf.size() bytes.
+ * Transfer::get() returns the bytes read or < 0 on error.
+ */
+Transfer Context::read_async(Bytes buf)
+{
+    if (buf.size() > (uint64_t)max_io_size)
+    {
+        d->ftdi->error_str = "transfer too large";
+        return Transfer(0, -1);
+    }
+
+    struct ftdi_transfer_control *tc = ftdi_read_data_submit(d->ftdi, buf.data(), (int)buf.size());
+    return Transfer(tc, tc ? 0 : -1);
+}
+
+/*! \brief Start writing buf, kept in flight as set by set_write_queue_depth().
+ * Transfer::get() returns the bytes written or < 0 on error.
+ */
+Transfer Context::write_async(ConstBytes buf)
+{
+    if (buf.size() > (uint64_t)max_io_size)
+    {
+        d->ftdi->error_str = "transfer too large";
+        return Transfer(0, -1);
+    }
+
+    // The data is only read, the C API just isn't const-correct
+    struct ftdi_transfer_control *tc = ftdi_write_data_submit(d->ftdi, const_cast<unsigned char *>(buf.data()), (int)buf.size());
+    return Transfer(tc, tc ? 0 : -1);
+}
+
+/*! \brief Start writing a list of fragments, which must outlive the Transfer.
+ * Transfer::get() returns the bytes written or < 0 on error.
+ */
+Transfer Context::writev_async(const struct ftdi_iovec *iov, int iovcnt)
+{
+    struct ftdi_transfer_control *tc = ftdi_write_datav_submit(d->ftdi, iov, iovcnt);
+    return Transfer(tc, tc ? 0 : -1);
+}
+
 int Context::set_flow_control(int flowctrl)
 {
     return ftdi_setflowctrl(d->ftdi, flowctrl);
@@ -536,7 +738,7 @@ List::List(struct ftdi_device_list* devlist)
             Context c;
             c.set_usb_device(devlist->dev);
             c.get_strings();
-            d->list.push_back(c);
+            d->list.push_back(std::move(c));
         }
     }
 }
@@ -654,21 +856,21 @@ void List::clear()
 }
 
 /**
- * Appends a copy of the element as the new last element.
- * @param element Value to copy and append
+ * Moves the element in as the new last element.
+ * @param element Value to move and append
 */
-void List::push_back(const Context& element)
+void List::push_back(Context&& element)
 {
-    d->list.push_back(element);
+    d->list.push_back(std::move(element));
 }
 
 /**
- * Adds a copy of the element as the new first element.
- * @param element Value to copy and add
+ * Moves the element in as the new first element.
+ * @param element Value to move and add
 */
-void List::push_front(const Context& element)
+void List::push_front(Context&& element)
 {
-    d->list.push_front(element);
+    d->list.push_front(std::move(element));
 }
 
 /**
@@ -236,6 +236,26 @@ enum ftdi_module_detach_mode
 
 #define SIO_RTS_CTS_HS (0x1 << 8)
 
+/** Transfer buffers kept for reuse per context */
+#define FTDI_BUFFER_POOL_SIZE 4
+/** Default transfer pool capacity, see ftdi_transfer_pool_reserve() */
+#define FTDI_TRANSFER_POOL_CONTROLS 4
+#define FTDI_TRANSFER_POOL_TRANSFERS 16
+/** Largest read transfer, outside Linux (which uses 16384) */
+#define FTDI_MAX_READ_CHUNKSIZE (256 * 1024)
+/** Overrun positions kept by struct ftdi_line_status_stats */
+#define FTDI_OVERRUN_POSITIONS 16
+
+/** Line status, second status byte of every read packet */
+#define FTDI_LS_DR   0x01
+#define FTDI_LS_OE   0x02
+#define FTDI_LS_PE   0x04
+#define FTDI_LS_FE   0x08
+#define FTDI_LS_BI   0x10
+#define FTDI_LS_THRE 0x20
+#define FTDI_LS_TEMT 0x40
+#define FTDI_LS_ERR  0x80
+
 /* marker for unused usb urb structures
    (taken from libusb) */
 #define FTDI_URB_USERCONTEXT_COOKIE ((void *)0x1)
@@ -253,6 +273,15 @@ enum ftdi_module_detach_mode
 #endif
 #endif
 
+/**
+    \brief Buffer fragment for ftdi_write_datav()
+*/
+struct ftdi_iovec
+{
+    const unsigned char *base;
+    int len;
+};
+
 struct ftdi_transfer_control
 {
     int completed;
@@ -261,6 +290,70 @@ struct ftdi_transfer_control
     int offset;
     struct ftdi_context *ftdi;
     struct libusb_transfer *transfer;
+    /** all transfers of a queued write (transfer is the first), else &transfer */
+    struct libusb_transfer **transfers;
+    /** number of entries in transfers */
+    int num_transfers;
+    /** transfers submitted and not completed yet */
+    int in_flight;
+    /** bytes handed to libusb so far */
+    int submitted;
+    /** array behind transfers when it isn't &transfer, kept while pooled */
+    struct libusb_transfer **transfer_array;
+    int transfer_array_size;
+    /** next control in the context's free pool */
+    struct ftdi_transfer_control *next_free;
+    /** write chunk size, fixed at submission */
+    int chunksize;
+    /** fragments of a vectored write and the next byte to send, else iov is NULL */
+    const struct ftdi_iovec *iov;
+    int iovcnt;
+    int iov_index;
+    int iov_offset;
+    /** one chunk per transfer for chunks gathered from several fragments, kept while pooled */
+    unsigned char *stage;
+    int stage_size;
+};
+
+/**
+    \brief Transfer pool usage, see ftdi_transfer_pool_get_stats()
+*/
+struct ftdi_transfer_pool_stats
+{
+    /** controls and libusb transfers taken from the pool */
+    unsigned long control_hits;
+    unsigned long transfer_hits;
+    /** allocated because the pool was exhausted */
+    unsigned long control_misses;
+    unsigned long transfer_misses;
+    /** freed on release because the pool was full */
+    unsigned long control_overflows;
+    unsigned long transfer_overflows;
+    /** in use now and at most */
+    unsigned int controls_in_use;
+    unsigned int transfers_in_use;
+    unsigned int controls_peak;
+    unsigned int transfers_peak;
+};
+
+/**
+    \brief Status bytes seen on reads, see ftdi_get_line_status_stats()
+*/
+struct ftdi_line_status_stats
+{
+    /** packets received, including status-only ones */
+    unsigned long packets;
+    /** packets flagging a receive overrun (FTDI_LS_OE) */
+    unsigned long overruns;
+    /** packets flagging a parity, framing, break or FIFO error */
+    unsigned long errors;
+    /** payload bytes received */
+    unsigned long long bytes;
+    /** payload offset of the first overrun packets, FTDI_OVERRUN_POSITIONS at most */
+    unsigned long long overrun_pos[FTDI_OVERRUN_POSITIONS];
+    /** modem and line status of the last packet */
+    unsigned char modem_status;
+    unsigned char line_status;
 };
 
 /**
@@ -321,6 +414,27 @@ struct ftdi_context
 
     /** Defines behavior in case a kernel module is already attached to the device */
     enum ftdi_module_detach_mode module_detach_mode;
+
+    /** number of write chunks kept in flight by ftdi_write_data_submit() */
+    unsigned int writebuffer_queue_depth;
+
+    /** allocated size of readbuffer, at least readbuffer_chunksize */
+    unsigned int readbuffer_size;
+    /** released transfer buffers and their sizes, recycled by ftdi_read_data_set_chunksize() */
+    unsigned char *buffer_pool[FTDI_BUFFER_POOL_SIZE];
+    unsigned int buffer_pool_size[FTDI_BUFFER_POOL_SIZE];
+
+    /** free transfer controls and libusb transfers reused by the submit calls */
+    struct ftdi_transfer_control *control_pool;
+    unsigned int control_pool_count;
+    unsigned int control_pool_max;
+    struct libusb_transfer **transfer_pool;
+    unsigned int transfer_pool_count;
+    unsigned int transfer_pool_max;
+    struct ftdi_transfer_pool_stats transfer_pool_stats;
+
+    /** status bytes stripped from read packets */
+    struct ftdi_line_status_stats line_status_stats;
 };
 
 /**
@@ -553,6 +667,9 @@ extern "C"
     int ftdi_usb_open_desc_index(struct ftdi_context *ftdi, int vendor, int product,
                                  const char* description, const char* serial, unsigned int index);
     int ftdi_usb_open_bus_addr(struct ftdi_context *ftdi, uint8_t bus, uint8_t addr);
+    int ftdi_usb_open_id_bus_addr(struct ftdi_context *ftdi, int vendor, int product, uint8_t bus, uint8_t addr);
+    int ftdi_usb_get_location(struct ftdi_context *ftdi, uint8_t *bus, uint8_t *addr, uint8_t *ports, int ports_len);
+    int ftdi_usb_get_serial(struct ftdi_context *ftdi, char *serial, int serial_len);
     int ftdi_usb_open_dev(struct ftdi_context *ftdi, struct libusb_device *dev);
     int ftdi_usb_open_string(struct ftdi_context *ftdi, const char* description);
 
@@ -579,14 +696,20 @@ extern "C"
     int ftdi_write_data(struct ftdi_context *ftdi, const unsigned char *buf, int size);
     int ftdi_write_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize);
     int ftdi_write_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunksize);
+    int ftdi_write_data_set_queue_depth(struct ftdi_context *ftdi, unsigned int depth);
+    int ftdi_write_data_get_queue_depth(struct ftdi_context *ftdi, unsigned int *depth);
 
     int ftdi_readstream(struct ftdi_context *ftdi, FTDIStreamCallback *callback,
                         void *userdata, int packetsPerTransfer, int numTransfers);
     struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size);
+    int ftdi_write_datav(struct ftdi_context *ftdi, const struct ftdi_iovec *iov, int iovcnt);
+    struct ftdi_transfer_control *ftdi_write_datav_submit(struct ftdi_context *ftdi, const struct ftdi_iovec *iov, int iovcnt);
 
     struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size);
     int ftdi_transfer_data_done(struct ftdi_transfer_control *tc);
     void ftdi_transfer_data_cancel(struct ftdi_transfer_control *tc, struct timeval * to);
+    int ftdi_transfer_pool_reserve(struct ftdi_context *ftdi, unsigned int controls, unsigned int transfers);
+    int ftdi_transfer_pool_get_stats(struct ftdi_context *ftdi, struct ftdi_transfer_pool_stats *stats);
 
     int ftdi_set_bitmode(struct ftdi_context *ftdi, unsigned char bitmask, unsigned char mode);
     int ftdi_disable_bitbang(struct ftdi_context *ftdi);
@@ -596,6 +719,8 @@ extern "C"
     int ftdi_get_latency_timer(struct ftdi_context *ftdi, unsigned char *latency);
 
     int ftdi_poll_modem_status(struct ftdi_context *ftdi, unsigned short *status);
+    int ftdi_get_line_status_stats(struct ftdi_context *ftdi, struct ftdi_line_status_stats *stats);
+    int ftdi_reset_line_status_stats(struct ftdi_context *ftdi);
 
     /* flow control */
     int ftdi_setflowctrl(struct ftdi_context *ftdi, int flowctrl);
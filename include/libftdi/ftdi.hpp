@@ -29,8 +29,11 @@ on this file might be covered by the GNU General Public License.
 #ifndef __libftdi_hpp__
 #define __libftdi_hpp__
 
+#include <stdint.h>
 #include <list>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <boost/shared_ptr.hpp>
 #include <libftdi/ftdi.h>
 
@@ -41,8 +44,85 @@ namespace Ftdi
 class List;
 class Eeprom;
 
+/*! \brief Non-owning view of a byte buffer.
+ * Like std::span: built from a pointer and a 64-bit size, a C array or any
+ * contiguous byte container (std::vector, std::array, std::span, ...).
+ */
+template <typename T>
+class BasicBytes
+{
+public:
+    BasicBytes() : p(0), n(0) {}
+    BasicBytes(T *data, uint64_t size) : p(data), n(size) {}
+
+    template <size_t N>
+    BasicBytes(T (&array)[N]) : p(array), n(N) {}
+
+    template <typename C, typename = typename std::enable_if<
+                  std::is_convertible<decltype(std::declval<C&>().data()), T*>::value &&
+                  sizeof(*std::declval<C&>().data()) == 1>::type>
+    BasicBytes(C&& container) : p(container.data()), n(container.size()) {}
+
+    T *data() const { return p; }
+    uint64_t size() const { return n; }
+    bool empty() const { return n == 0; }
+
+    /// Bytes [offset, offset + count), clamped to the view
+    BasicBytes subspan(uint64_t offset, uint64_t count = UINT64_MAX) const
+    {
+        if (offset > n)
+            offset = n;
+        if (count > n - offset)
+            count = n - offset;
+        return BasicBytes(p + offset, count);
+    }
+
+private:
+    T *p;
+    uint64_t n;
+};
+
+/// Writable byte view
+typedef BasicBytes<unsigned char> Bytes;
+/// Read-only byte view, any Bytes converts to it
+typedef BasicBytes<const unsigned char> ConstBytes;
+
+/*! \brief Pending asynchronous transfer.
+ * Returned by Context::read_async() and Context::write_async() and owns the
+ * underlying transfer: get() waits for it and returns its result once, and a
+ * Transfer dropped before that cancels it, so nothing leaks. Move-only. The
+ * buffer and the Context must outlive the Transfer.
+ */
+class Transfer
+{
+public:
+    Transfer();
+    Transfer(Transfer&& other);
+    Transfer& operator=(Transfer&& other);
+    ~Transfer();
+
+    Transfer(const Transfer&) = delete;
+    Transfer& operator=(const Transfer&) = delete;
+
+    /// True until the result has been taken by get() or the transfer cancelled
+    bool valid() const;
+    /// Wait for completion; bytes transferred or < 0 on error
+    int64_t get();
+    /// Cancel the transfer if it is still pending and drop it
+    void cancel();
+
+private:
+    friend class Context;
+    Transfer(struct ftdi_transfer_control *tc, int64_t result);
+
+    struct ftdi_transfer_control *tc;
+    int64_t result;
+    bool pending;
+};
+
 /*! \brief FTDI device context.
- * Represents single FTDI device context.
+ * Represents single FTDI device context. Owns the device: move-only, a moved-from
+ * Context may only be assigned to or destroyed.
  */
 class Context
 {
@@ -70,6 +150,11 @@ public:
     /* Constructor, Destructor */
     Context();
     ~Context();
+    Context(Context&& other);
+    Context& operator=(Context&& other);
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
 
     /* Properties */
     Eeprom* eeprom();
@@ -106,12 +191,22 @@ public:
     int set_write_chunk_size(unsigned int chunksize);
     int read_chunk_size();
     int write_chunk_size();
-
-    /* Async IO
-    TODO: should wrap?
-    int writeAsync(const unsigned char *buf, int size);
-    void asyncComplete(int wait_for_more);
-    */
+    int set_write_queue_depth(unsigned int depth);
+    int write_queue_depth();
+    int reserve_transfer_pool(unsigned int controls, unsigned int transfers);
+    struct ftdi_transfer_pool_stats transfer_pool_stats();
+    struct ftdi_line_status_stats line_status_stats();
+    int reset_line_status_stats();
+
+    /* I/O on byte views, any size */
+    int64_t read(Bytes buf);
+    int64_t write(ConstBytes buf);
+    int writev(const struct ftdi_iovec *iov, int iovcnt);
+
+    /* Async IO */
+    Transfer read_async(Bytes buf);
+    Transfer write_async(ConstBytes buf);
+    Transfer writev_async(const struct ftdi_iovec *iov, int iovcnt);
 
     /* Flow control */
     int set_event_char(unsigned char eventch, unsigned char enable);
@@ -145,7 +240,7 @@ protected:
 
 private:
     class Private;
-    boost::shared_ptr<Private> d;
+    std::unique_ptr<Private> d;
 };
 
 /*! \brief Device EEPROM.
@@ -206,8 +301,8 @@ public:
     bool empty() const;
     void clear();
 
-    void push_back(const Context& element);
-    void push_front(const Context& element);
+    void push_back(Context&& element);
+    void push_front(Context&& element);
 
     iterator erase(iterator pos);
     iterator erase(iterator beg, iterator end);
@@ -0,0 +1,191 @@
+// Board description (FT232H pins, DACx0501, LTC230x) and the MPSSE command
+// fragments shared by the tools. Each helper appends to a command buffer and
+// advances the write index, and the read index for commands returning data.
+
+#ifndef OSCI_BOARD_HPP
+#define OSCI_BOARD_HPP
+
+#include <stdint.h>
+#include <libftdi/ftdi.h>
+#include <osci/devcache.hpp>
+
+// Config for FT232
+namespace Ft232 {
+   // Enumerate the AD bus for convenience.
+   enum pins {
+      SK = 0x01, // ADBUS0, SPI data clock
+      DO = 0x02, // ADBUS1, SPI data out
+      DI = 0x04, // ADBUS2, SPI data in
+      CS0 = 0x08, // ADBUS3, SPI chip select
+      CS1 = 0x10, // ADBUS4, general-ourpose i/o, GPIOL0
+      CS2 = 0x20, // ADBUS5, general-ourpose i/o, GPIOL1
+      CS3 = 0x40, // ADBUS6, general-ourpose i/o, GPIOL2
+      l3 = 0x80  // ADBUS7, general-ourpose i/o, GPIOL3
+   };
+
+   // Chip-specific info
+   const uint16_t vendor = 0x0403;
+   const uint16_t product = 0x6014;
+
+   const uint8_t pinInitialState = pins::CS0|pins::CS1|pins::CS2|pins::CS3; // Set these pins high
+   const uint8_t pinDirection    = pins::SK|pins::DO|pins::CS0|pins::CS1|pins::CS2|pins::CS3; // Use these pins as outputs
+
+   const uint8_t adcCs[3] = {pins::CS0, pins::CS1, pins::CS2}; // chip selects of ADC0..2
+   const uint8_t dacCs = pins::CS3;
+}
+
+// Multi-interface chips: one MPSSE engine per interface, each with the FT232H
+// pin layout on its own bus (ADBUS for A, BDBUS for B)
+namespace Ft2232 {
+   const uint16_t product = 0x6010;
+}
+
+namespace Ft4232 {
+   const uint16_t product = 0x6011; // MPSSE on A and B only
+}
+
+// DAC register offsets
+namespace Dacx0501{
+   const uint8_t DAC_DATA = 0x08;
+   const uint8_t CONFIG = 0x03;
+}
+
+// ADC configuration bits
+namespace Lt230x{
+   enum config{
+      SINGLE_ENDED = 0x80,
+      ODD = 0x40,
+      SELECT1 = 0x20, // LTC2308 only
+      SELECT0 = 0x10, // LTC2308 only
+      UNIPOLAR = 0x08
+   };
+}
+
+namespace Osci{
+   const int32_t setupCmdBytes = 18;
+   const int32_t clockCmdBytes = 6;
+   const int32_t dacCmdBytes = 9;
+   const int32_t adcCmdBytes = 9;
+   const int32_t adcReadBytes = 2;
+   const int32_t releaseCmdBytes = 3;
+
+   // Estimated MPSSE timing in SK clocks, used to schedule the sample frame
+   const int32_t cmdGapClocks = 2; // opcode decode between commands (estimate)
+   const int32_t setBitsClocks = cmdGapClocks;
+   const int32_t dacWriteClocks = setBitsClocks + cmdGapClocks + 24;           // writeDac
+   const int32_t adcReadClocks = setBitsClocks + cmdGapClocks + 8 + cmdGapClocks + 4; // readAdc
+   const int32_t adcMuxClocks = setBitsClocks + cmdGapClocks + 6; // the mux is set on the 6th config bit
+
+   // SK period in ns for a TCK divisor (60 MHz / ((1+divisor)*2))
+   inline double skPeriodNs(uint16_t divisor = 0x0000){
+      return (1 + divisor)*2*1000.0/60.0;
+   }
+
+   // Clock and clocking modes (divisor: 60 MHz / ((1+divisor)*2))
+   inline void setupClock(uint8_t* buf, int32_t* iWrite, uint16_t divisor = 0x0000){
+      buf[(*iWrite)++] = 0x8A;            // opcode: disable div by 5
+      buf[(*iWrite)++] = TCK_DIVISOR;     // opcode: set clk divisor
+      buf[(*iWrite)++] = (uint8_t) (divisor & 0xFF); // argument: low bit. 0 ==> 30 MHz
+      buf[(*iWrite)++] = (uint8_t) (divisor >> 8);   // argument: high bit.
+      buf[(*iWrite)++] = DIS_ADAPTIVE;    // opcode: disable adaptive clocking
+      buf[(*iWrite)++] = DIS_3_PHASE;     // opcode: disable 3-phase clocking
+   }
+
+   // Clock, clocking modes and DAC configuration (divisor: 60 MHz / ((1+divisor)*2))
+   inline void setupMpsse(uint8_t* buf, int32_t* iWrite, uint16_t divisor = 0x0000){
+      setupClock(buf, iWrite, divisor);
+
+      buf[(*iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = Ft232::pinInitialState & ~Ft232::dacCs; // argument: inital pin states, select DAC
+      buf[(*iWrite)++] = Ft232::pinDirection; // argument: pin direction
+
+      buf[(*iWrite)++] = MPSSE_DO_WRITE; // opcode: write on rising clock edge
+      buf[(*iWrite)++] = 0x02; // argument: length low byte, 0x0002 ==> 3 bytes
+      buf[(*iWrite)++] = 0x00; // argument: length high byte
+      buf[(*iWrite)++] = Dacx0501::CONFIG; // argument: first byte content -> configure DAC
+      buf[(*iWrite)++] = (uint8_t) 0x01; // argument: second byte content -> disable internal ref
+      buf[(*iWrite)++] = (uint8_t) 0x00; // argument: third byte content
+
+      buf[(*iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = Ft232::pinInitialState; // argument: inital pin states, default
+      buf[(*iWrite)++] = Ft232::pinDirection; // argument: pin direction (keep default)
+   }
+
+   // Select the DAC and send a 12bit value (60501 needs the 4 last bits to be 0)
+   inline void writeDac(uint8_t* buf, int32_t* iWrite, uint16_t dacVal){
+      buf[(*iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = Ft232::pinInitialState & ~Ft232::dacCs; // argument: inital pin states, select DAC
+      buf[(*iWrite)++] = Ft232::pinDirection; // argument: pin direction
+
+      buf[(*iWrite)++] = MPSSE_DO_WRITE; // opcode: write on rising clock edge
+      buf[(*iWrite)++] = 0x02; // argument: length low byte, 0x0002 ==> 3 bytes
+      buf[(*iWrite)++] = 0x00; // argument: length high byte
+      buf[(*iWrite)++] = Dacx0501::DAC_DATA; // argument: first byte content -> send DAC value
+      buf[(*iWrite)++] = (uint8_t) (((dacVal & 0x0FF0) >> 4) & 0x00FF); // argument: second byte content -> send MSB
+      buf[(*iWrite)++] = (uint8_t) ((dacVal & 0x000F) << 4); // argument: third byte content -> send LSB
+   }
+
+   // Select one ADC, send its config byte while reading the first 8 bits, then read 4 more bits
+   inline void readAdc(uint8_t* buf, int32_t* iWrite, int32_t* iRead, uint8_t cs, uint8_t config, uint8_t readEdge = 0){
+      buf[(*iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = Ft232::pinInitialState & ~cs; // argument: inital pin states, select ADC
+      buf[(*iWrite)++] = Ft232::pinDirection; // argument: pin direction
+
+      buf[(*iWrite)++] = MPSSE_DO_READ | MPSSE_DO_WRITE | readEdge; // opcode: write on rising clock edge, read on rising (or falling) clock edge
+      buf[(*iWrite)++] = 0x00; // length low byte, 0x0000 ==> 1 bytes
+      buf[(*iWrite)++] = 0x00; // length high byte
+      buf[(*iWrite)++] = config;
+
+      buf[(*iWrite)++] = MPSSE_DO_READ | MPSSE_BITMODE | readEdge; // opcode: read bits
+      buf[(*iWrite)++] = 0x03; // length, 0x0003 ==> 4 bits
+      (*iRead) += adcReadBytes; // read 12 bits on 2 bytes (the MSB of the second byte is irrelevant)
+   }
+
+   // Clock SK without transferring data, chip selects unchanged. Returns the cost in SK clocks.
+   inline int32_t idleClocks(uint8_t* buf, int32_t* iWrite, int32_t clocks){
+      int32_t cost = 0;
+      while(clocks >= 8){
+         int32_t bytes = clocks/8 > 0x10000 ? 0x10000 : clocks/8;
+         buf[(*iWrite)++] = CLK_BYTES; // opcode: clock n*8 bits, no data
+         buf[(*iWrite)++] = (uint8_t) ((bytes - 1) & 0xFF); // argument: length low byte
+         buf[(*iWrite)++] = (uint8_t) ((bytes - 1) >> 8);   // argument: length high byte
+         clocks -= bytes*8;
+         cost += bytes*8 + cmdGapClocks;
+      }
+      if(clocks > 0){
+         buf[(*iWrite)++] = CLK_BITS; // opcode: clock n bits, no data
+         buf[(*iWrite)++] = (uint8_t) (clocks - 1); // argument: length, 0x00 ==> 1 bit
+         cost += clocks + cmdGapClocks;
+      }
+      return cost;
+   }
+
+   // Deselect all chips
+   inline void releaseCs(uint8_t* buf, int32_t* iWrite){
+      buf[(*iWrite)++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = Ft232::pinInitialState; // argument: inital pin states, default
+      buf[(*iWrite)++] = Ft232::pinDirection; // argument: pin direction (keep default)
+   }
+
+   // Open an FT232H (see openDevice), or one interface of a multi-interface chip, and
+   // put it in MPSSE mode. Returns 0 or the libftdi error code.
+   inline int openMpsse(struct ftdi_context* context, const char* serial = NULL,
+                        enum ftdi_interface interface = INTERFACE_ANY, uint16_t product = Ft232::product){
+      int ftdi_status = ftdi_init(context);
+      if ( ftdi_status != 0 ) {
+         return ftdi_status;
+      }
+      ftdi_set_interface(context, interface); // can't be changed once open
+      ftdi_status = openDevice(context, Ft232::vendor, product, serial);
+      if ( ftdi_status != 0 ) {
+         return ftdi_status;
+      }
+      ftdi_usb_reset(context);
+      ftdi_set_bitmode(context, 0, 0); // reset
+      ftdi_set_bitmode(context, 0, BITMODE_MPSSE); // enable mpsse on all bits
+      ftdi_tcioflush(context);
+      return 0;
+   }
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Swept-sine frequency response. Each step plays a sine on the DAC whose period
+// divides the block length exactly (coherent: the stimulus frequency is rounded
+// to a whole number of cycles per block), so the same block of commands can be
+// queued back to back for as long as the step lasts and the lock-in sums below
+// have no leakage from DC, harmonics or the other steps' transients.
+//
+// Every column is demodulated synchronously against the stimulus: its complex
+// amplitude at the step frequency over one block, divided by the DAC's, is the
+// response H(f). A step is settled once H moves less than bodeSettleTol between
+// consecutive blocks; the ADC conversion latency of each read slot (see
+// ScanList::latency) is taken out of the phase.
+
+#ifndef OSCI_BODE_HPP
+#define OSCI_BODE_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <osci/decimate.hpp>
+
+namespace Osci{
+   const int32_t bodeMinFrames = 4096;  // frames per block
+   const int32_t bodeMinCycles = 8;     // stimulus periods per block
+   const int bodeMaxBlocks = 32;        // blocks per step before giving up on settling
+   const double bodeSettleTol = 1e-3;   // relative change of H between blocks (~0.06 deg)
+
+   struct BodeStep{
+      double freq;    // cycles per frame
+      int32_t frames; // per block
+      int32_t cycles; // per block
+   };
+
+   // Coherent step closest to f (cycles per frame): at least minFrames frames and
+   // minCycles periods per block, below Nyquist
+   inline BodeStep bodeStep(double f, int32_t minFrames = bodeMinFrames, int32_t minCycles = bodeMinCycles){
+      BodeStep s;
+      s.frames = minFrames;
+      if(f > 0 && minCycles/f > s.frames) s.frames = (int32_t) ceil(minCycles/f);
+      s.cycles = (int32_t) floor(f*s.frames + 0.5);
+      if(s.cycles < 1) s.cycles = 1;
+      if(s.cycles > s.frames/2 - 1) s.cycles = s.frames/2 - 1;
+      s.freq = (double) s.cycles/s.frames;
+      return s;
+   }
+
+   // Logarithmic sweep of n frequencies from f0 to f1
+   inline std::vector<double> logSweep(double f0, double f1, int n){
+      std::vector<double> f;
+      for(int i = 0; i < n; i++){
+         f.push_back(n > 1 ? f0*pow(f1/f0, (double) i/(n - 1)) : f0);
+      }
+      return f;
+   }
+
+   // One frequency per line. Returns false if the file can't be read or is empty.
+   inline bool loadFrequencies(const char* path, std::vector<double>* f){
+      std::ifstream in(path);
+      std::string line;
+      f->clear();
+      while(getline(in, line)){
+         if(!line.empty() && line[0] != '#') f->push_back(atof(line.c_str()));
+      }
+      return !f->empty();
+   }
+
+   // Lock-in for one step: sine and cosine tables of one block
+   class Lockin{
+   public:
+      // DAC codes of one block: offset + amplitude*sin(2 pi freq k)
+      void start(const BodeStep& s, uint16_t offset, uint16_t amplitude, uint16_t* codes){
+         step_ = s;
+         ref_.resize(s.frames);
+         for(int32_t k = 0; k < s.frames; k++){
+            // Whole cycles per block: the phase is taken modulo the block exactly
+            double ph = 2*M_PI*(double) (((int64_t) s.cycles*k) % s.frames)/s.frames;
+            ref_[k] = std::polar(1.0, -ph);
+            codes[k] = (uint16_t) floor(offset + amplitude*sin(ph) + 0.5);
+         }
+         // The stimulus as played, rounding included
+         stimulus_ = 0;
+         for(int32_t k = 0; k < s.frames; k++) stimulus_ += (double) codes[k]*ref_[k];
+         stimulus_ *= 2.0/s.frames;
+      }
+
+      // Response of column c of one block of interleaved frames; latency in frames
+      std::complex<double> response(const uint16_t* adc, int columns, int c, int latency = 0) const{
+         std::complex<double> acc = 0;
+         for(int32_t k = 0; k < step_.frames; k++){
+            acc += (double) adcSigned(adc[(size_t)k*columns + c])*ref_[k];
+         }
+         acc *= 2.0/step_.frames;
+         return acc/stimulus_*std::polar(1.0, 2*M_PI*step_.freq*latency);
+      }
+
+      const BodeStep& step() const{ return step_; }
+
+   private:
+      BodeStep step_ = {0, 0, 0};
+      std::vector<std::complex<double>> ref_;
+      std::complex<double> stimulus_;
+   };
+
+   // True once every column's response moved less than tol since the last block
+   inline bool settled(const std::vector<std::complex<double>>& h, const std::vector<std::complex<double>>& prev,
+                       double tol = bodeSettleTol){
+      if(prev.size() != h.size()) return false;
+      for(size_t c = 0; c < h.size(); c++){
+         if(std::abs(h[c] - prev[c]) > tol*std::abs(prev[c])) return false;
+      }
+      return true;
+   }
+}
+
+#endif
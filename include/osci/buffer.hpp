@@ -0,0 +1,66 @@
+// Capture buffers sized to the run. Large buffers can be backed by mmap with
+// explicit (MAP_HUGETLB) or transparent huge pages to cut TLB misses during decode.
+
+#ifndef OSCI_BUFFER_HPP
+#define OSCI_BUFFER_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace Osci{
+   const size_t hugePageSize = 2*1024*1024; // default x86-64/arm64 huge page
+
+   struct Buffer{
+      uint8_t* data = NULL;
+      size_t size = 0;   // usable bytes
+      size_t mapped = 0; // bytes mapped with mmap, 0 if allocated with malloc
+   };
+
+   // Allocate size bytes (not zeroed). With hugePages, buffers of at least one
+   // huge page are mapped with explicit huge pages, falling back to transparent
+   // ones when none are reserved. Returns false if the allocation failed.
+   inline bool allocBuffer(Buffer* buf, size_t size, bool hugePages){
+      buf->size = size;
+      buf->mapped = 0;
+#ifdef __linux__
+      if(hugePages && size >= hugePageSize){
+         size_t len = (size + hugePageSize - 1) & ~(hugePageSize - 1);
+         void* p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+         if(p == MAP_FAILED){ // no reserved huge pages, ask for transparent ones
+            p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if(p != MAP_FAILED){
+               madvise(p, len, MADV_HUGEPAGE);
+            }
+         }
+         if(p != MAP_FAILED){
+            buf->data = (uint8_t*) p;
+            buf->mapped = len;
+            return true;
+         }
+      }
+#else
+      (void) hugePages;
+#endif
+      buf->data = (uint8_t*) malloc(size > 0 ? size : 1);
+      return buf->data != NULL;
+   }
+
+   inline void freeBuffer(Buffer* buf){
+#ifdef __linux__
+      if(buf->mapped){
+         munmap(buf->data, buf->mapped);
+      }else
+#endif
+      {
+         free(buf->data);
+      }
+      buf->data = NULL;
+      buf->size = 0;
+      buf->mapped = 0;
+   }
+}
+
+#endif
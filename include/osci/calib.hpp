@@ -0,0 +1,75 @@
+// Per-board SPI clock calibration: the fastest TCK divisor and read edge whose
+// DAC->ADC loopback readings match a slow reference (see ftdi_calibrate).
+// Settings are stored as calib_<serial>.txt, keyed on the EEPROM serial number.
+
+#ifndef OSCI_CALIB_HPP
+#define OSCI_CALIB_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fstream>
+#include <string>
+#include <libftdi/ftdi.h>
+
+namespace Osci{
+   struct SpiSetting{
+      uint16_t divisor = 0x0000; // 30 MHz
+      uint8_t readEdge = 0;      // 0: rising, MPSSE_READ_NEG: falling
+   };
+
+   // Serial number from the USB descriptor or else the EEPROM, "default" if it can't be read
+   inline std::string boardSerial(struct ftdi_context* context){
+      char serial[64];
+      if(ftdi_usb_get_serial(context, serial, sizeof(serial)) == 0 && serial[0] != '\0'){
+         return serial;
+      }
+      if(ftdi_read_eeprom(context) == 0 && ftdi_eeprom_decode(context, 0) == 0
+         && ftdi_eeprom_get_strings(context, NULL, 0, NULL, 0, serial, sizeof(serial)) == 0 && serial[0] != '\0'){
+         return serial;
+      }
+      return "default";
+   }
+
+   inline const char* edgeName(uint8_t readEdge){
+      return readEdge ? "falling" : "rising";
+   }
+
+   inline std::string calibPath(const std::string& serial){
+      return "calib_" + serial + ".txt";
+   }
+
+   // Format: "divisor <n>" and "edge rising|falling" lines. Returns false, leaving s
+   // unchanged, if the file can't be read or a line is malformed.
+   inline bool loadCalibration(const std::string& path, SpiSetting* s){
+      std::ifstream in(path);
+      if(!in) return false;
+      SpiSetting loaded = *s;
+      std::string key, val;
+      while(in >> key){
+         if(!(in >> val)) return false; // a key without a value
+         if(key == "divisor"){
+            char* end;
+            errno = 0;
+            long d = strtol(val.c_str(), &end, 0);
+            if(end == val.c_str() || *end != '\0' || errno != 0 || d < 0 || d > 0xFFFF) return false;
+            loaded.divisor = (uint16_t) d;
+         }else if(key == "edge"){
+            if(val == "falling") loaded.readEdge = MPSSE_READ_NEG;
+            else if(val == "rising") loaded.readEdge = 0;
+            else return false;
+         }else return false;
+      }
+      *s = loaded;
+      return true;
+   }
+
+   inline bool saveCalibration(const std::string& path, const SpiSetting& s){
+      std::ofstream out(path);
+      out << "divisor " << s.divisor << '\n'
+          << "edge " << edgeName(s.readEdge) << '\n';
+      return (bool) out;
+   }
+}
+
+#endif
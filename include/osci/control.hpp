@@ -0,0 +1,53 @@
+// Controllers for the closed-loop mode: ADC values in, next DAC code out.
+
+#ifndef OSCI_CONTROL_HPP
+#define OSCI_CONTROL_HPP
+
+#include <stdint.h>
+#include <osci/postprocess.hpp>
+
+namespace Osci{
+   const uint16_t dacMax = 0x0FFF; // 12bit DAC
+
+   // User-supplied controllers derive from this. step() is called once per round
+   // trip with the freshly read ADC values and the time since the previous call.
+   class Controller{
+   public:
+      virtual ~Controller(){}
+      virtual uint16_t step(const uint16_t* adc, double dt) = 0;
+   };
+
+   // PID on one ADC channel (in volts), output in DAC codes around a bias.
+   // The integrator stops while the output is saturated (anti-windup).
+   class Pid : public Controller{
+   public:
+      Pid(int channel, float setpoint, float kp, float ki, float kd, float bias = dacMax/2.0)
+         : channel_(channel), setpoint_(setpoint), kp_(kp), ki_(ki), kd_(kd), bias_(bias){}
+
+      uint16_t step(const uint16_t* adc, double dt) override{
+         float err = setpoint_ - outToVolt(adc[channel_]);
+         float deriv = (first_ || dt <= 0) ? 0 : (err - prevErr_)/dt;
+         first_ = false;
+         prevErr_ = err;
+
+         float integ = integ_ + err*dt;
+         float u = bias_ + kp_*err + ki_*integ + kd_*deriv;
+         if(u < 0){
+            u = 0;
+         }else if(u > dacMax){
+            u = dacMax;
+         }else{
+            integ_ = integ;
+         }
+         return (uint16_t) (u + 0.5f);
+      }
+
+   private:
+      int channel_;
+      float setpoint_, kp_, ki_, kd_, bias_;
+      float integ_ = 0, prevErr_ = 0;
+      bool first_ = true;
+   };
+}
+
+#endif
@@ -0,0 +1,197 @@
+// Streaming decimation of oversampled channels to lower-rate, higher-resolution
+// output. A CIC filter (integer, order N, decimation R) does the bulk of the rate
+// reduction without multiplies; a windowed FIR running at its output rate
+// compensates the CIC passband droop and decimates by a further factor D,
+// computing only the outputs that are kept (polyphase). Filters keep their
+// state between calls, so a capture can be fed in pieces.
+//
+// The FIR dot product runs over contiguous float arrays in firLanes independent
+// partial sums, so -O3 vectorizes it without -ffast-math.
+
+#ifndef OSCI_DECIMATE_HPP
+#define OSCI_DECIMATE_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <sstream>
+#include <vector>
+
+namespace Osci{
+   const int cicOrder = 3;
+   const int firTaps = 48;
+   const int firLanes = 8; // partial sums of the FIR dot product, one AVX register of floats
+   const double firPassband = 0.8; // fraction of the output Nyquist band kept flat
+
+   // 12bit two's complement ADC code to a signed value
+   inline int32_t adcSigned(uint16_t out){
+      return (int32_t) (out & 0x7FF) - (int32_t) (out & 0x800);
+   }
+
+   // Signed (possibly fractional) ADC code to volts, see outToVolt
+   inline double codeToVolt(double code){
+      return ((code + 2048.0)/4095.0)*5.0 - 2.5;
+   }
+
+   class Cic{
+   public:
+      Cic(int r, int order = cicOrder) : r_(r), order_(order), integ_(order, 0), comb_(order, 0){
+         gain_ = pow((double) r, order);
+      }
+
+      // Feed one sample, returns true with *out set every r samples
+      bool push(int32_t x, double* out){
+         // Unsigned wrap-around in the integrators is undone exactly by the combs
+         uint64_t v = (uint64_t) (int64_t) x;
+         for(int i = 0; i < order_; i++){
+            integ_[i] += v;
+            v = integ_[i];
+         }
+         if(++phase_ < r_) return false;
+         phase_ = 0;
+         for(int i = 0; i < order_; i++){
+            uint64_t prev = comb_[i];
+            comb_[i] = v;
+            v -= prev;
+         }
+         *out = (int64_t) v/gain_;
+         return true;
+      }
+
+      int factor() const{ return r_; }
+      int order() const{ return order_; }
+
+   private:
+      int r_, order_, phase_ = 0;
+      std::vector<uint64_t> integ_, comb_;
+      double gain_;
+   };
+
+   // Decimating FIR compensating the droop of a CIC (r, order) in front of it
+   class CompFir{
+   public:
+      CompFir(int d, int cicR, int order = cicOrder, int taps = firTaps)
+         : d_(d), taps_(taps, 0.0f){
+         // Frequency-sampling design: inverse CIC response over the passband,
+         // zero above, Blackman window, unity gain at DC
+         const int grid = 1024;
+         double pb = firPassband*0.5/d;
+         double c = (taps - 1)/2.0, sum = 0;
+         for(int n = 0; n < taps; n++){
+            double h = 0;
+            for(int k = 0; k < grid; k++){
+               double f = (k + 0.5)*pb/grid; // cycles per FIR input sample
+               double cic = fabs(sin(M_PI*f)/(cicR*sin(M_PI*f/cicR)));
+               h += pow(cic, -order)*cos(2*M_PI*f*(n - c));
+            }
+            double w = 0.42 - 0.5*cos(2*M_PI*n/(taps - 1)) + 0.08*cos(4*M_PI*n/(taps - 1));
+            taps_[n] = (float) (h*w);
+            sum += taps_[n];
+         }
+         for(auto& t : taps_) t = (float) (t/sum);
+         // Reversed and zero-padded in front to whole lanes, so the dot product
+         // runs forward over the history, oldest first
+         int n = (taps + firLanes - 1)/firLanes*firLanes;
+         coef_.assign(n, 0.0f);
+         for(int i = 0; i < taps; i++) coef_[n - 1 - i] = taps_[i];
+         hist_.assign(2*n, 0.0f);
+      }
+
+      // Feed one sample, returns true with *out set every d samples
+      bool push(double x, double* out){
+         // History kept twice so the last taps samples are always contiguous
+         int n = (int) coef_.size();
+         hist_[pos_] = hist_[pos_ + n] = (float) x;
+         pos_ = (pos_ + 1) % n;
+         if(++phase_ < d_) return false;
+         phase_ = 0;
+         const float* h = hist_.data() + pos_; // oldest first
+         const float* c = coef_.data();
+         float part[firLanes] = {};
+         for(int i = 0; i < n; i += firLanes){
+            for(int l = 0; l < firLanes; l++) part[l] += c[i + l]*h[i + l];
+         }
+         float acc = 0;
+         for(int l = 0; l < firLanes; l++) acc += part[l];
+         *out = acc;
+         return true;
+      }
+
+      int factor() const{ return d_; }
+
+   private:
+      int d_, pos_ = 0, phase_ = 0;
+      std::vector<float> taps_, coef_, hist_; // designed taps, reversed padded taps, history
+   };
+
+   // CIC followed by the compensating FIR for a total decimation factor. Even
+   // factors leave 2 to the FIR, odd ones go to the CIC alone (compensated, D=1).
+   class Decimator{
+   public:
+      explicit Decimator(int factor)
+         : cic_(factor % 2 == 0 ? factor/2 : factor), fir_(factor % 2 == 0 ? 2 : 1, cic_.factor()), factor_(factor){}
+
+      bool push(int32_t x, double* out){
+         if(factor_ == 1){
+            *out = x;
+            return true;
+         }
+         double c;
+         return cic_.push(x, &c) && fir_.push(c, out);
+      }
+
+      int factor() const{ return factor_; }
+
+   private:
+      Cic cic_;
+      CompFir fir_;
+      int factor_;
+   };
+
+   // One decimator per column of interleaved frames
+   class ChannelDecimators{
+   public:
+      explicit ChannelDecimators(const std::vector<int>& factors){
+         for(int f : factors) dec_.emplace_back(f);
+         out.resize(factors.size());
+      }
+
+      // Feed nFrames frames of channels() ADC codes; outputs are appended to out
+      void process(const uint16_t* adc, int32_t nFrames){
+         int nc = channels();
+         for(int32_t f = 0; f < nFrames; f++){
+            for(int c = 0; c < nc; c++){
+               double y;
+               if(dec_[c].push(adcSigned(adc[(size_t)f*nc + c]), &y)) out[c].push_back(y);
+            }
+         }
+      }
+
+      int channels() const{ return (int) dec_.size(); }
+      int factor(int c) const{ return dec_[c].factor(); }
+
+      std::vector<std::vector<double>> out; // decimated signed ADC codes per channel
+
+   private:
+      std::vector<Decimator> dec_;
+   };
+
+   // "16" for every column or "16,4,1" per column. Returns false on a bad list.
+   inline bool parseFactors(const char* spec, int columns, std::vector<int>* factors){
+      std::vector<int> f;
+      std::stringstream ss(spec);
+      std::string item;
+      while(getline(ss, item, ',')){
+         int v = atoi(item.c_str());
+         if(v < 1) return false;
+         f.push_back(v);
+      }
+      if(f.size() == 1) f.assign(columns, f[0]);
+      if((int) f.size() != columns) return false;
+      *factors = f;
+      return true;
+   }
+}
+
+#endif
@@ -0,0 +1,110 @@
+// Device identity cache: serial number -> USB bus, address and port path, stored
+// in devices.txt with the most recently opened board first. Opening goes straight
+// to the cached bus/address (ftdi_usb_open_bus_addr, guarded by vendor/product)
+// and checks the serial and port path there with one string descriptor, instead
+// of opening every matching device on the bus. Only on a miss (board replugged,
+// moved or never seen) does it fall back to full enumeration, and the cache is
+// updated with where the board turned up.
+
+#ifndef OSCI_DEVCACHE_HPP
+#define OSCI_DEVCACHE_HPP
+
+#include <stdint.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <libftdi/ftdi.h>
+
+namespace Osci{
+   const char* const deviceCachePath = "devices.txt";
+   const int maxPortDepth = 7; // USB 3.0 allows 7 tiers
+
+   struct DeviceId{
+      std::string serial;
+      int bus = 0;
+      int addr = 0;
+      std::string ports; // hub port numbers from the root, e.g. "1.4.2"
+   };
+
+   // Format: one "serial bus addr ports" line per board, most recent first
+   inline std::vector<DeviceId> loadDeviceCache(const std::string& path = deviceCachePath){
+      std::vector<DeviceId> ids;
+      std::ifstream in(path);
+      std::string line;
+      while(getline(in, line)){
+         std::stringstream ss(line);
+         DeviceId id;
+         if(ss >> id.serial >> id.bus >> id.addr >> id.ports) ids.push_back(id);
+      }
+      return ids;
+   }
+
+   inline bool saveDeviceCache(const std::vector<DeviceId>& ids, const std::string& path = deviceCachePath){
+      std::ofstream out(path);
+      for(const DeviceId& id : ids){
+         out << id.serial << ' ' << id.bus << ' ' << id.addr << ' ' << id.ports << '\n';
+      }
+      return (bool) out;
+   }
+
+   // Identity of the open device; the serial is "-" if it has none
+   inline bool deviceIdOf(struct ftdi_context* context, DeviceId* id){
+      uint8_t bus, addr, ports[maxPortDepth];
+      char serial[64];
+      int n = ftdi_usb_get_location(context, &bus, &addr, ports, maxPortDepth);
+      if(n < 0 || ftdi_usb_get_serial(context, serial, sizeof(serial)) != 0) return false;
+      id->serial = serial[0] != '\0' ? serial : "-";
+      id->bus = bus;
+      id->addr = addr;
+      id->ports.clear();
+      for(int i = 0; i < n; i++){
+         if(i > 0) id->ports += '.';
+         id->ports += std::to_string(ports[i]);
+      }
+      if(n == 0) id->ports = "0";
+      return true;
+   }
+
+   // Open the board with the given serial (NULL: the one opened last, else the first
+   // one found). Returns 0 or the libftdi error code of the enumerating open.
+   inline int openDevice(struct ftdi_context* context, int vendor, int product, const char* serial = NULL){
+      std::vector<DeviceId> ids = loadDeviceCache();
+      size_t hit = ids.size();
+      for(size_t i = 0; i < ids.size() && hit == ids.size(); i++){
+         if(serial == NULL || ids[i].serial == serial) hit = i;
+      }
+
+      DeviceId id;
+      if(hit < ids.size() && ftdi_usb_open_id_bus_addr(context, vendor, product, (uint8_t) ids[hit].bus, (uint8_t) ids[hit].addr) == 0){
+         // The address may have been reused by another device since
+         if(deviceIdOf(context, &id) && id.serial == ids[hit].serial && id.ports == ids[hit].ports){
+            if(hit > 0){
+               ids.erase(ids.begin() + hit);
+               ids.insert(ids.begin(), id);
+               saveDeviceCache(ids);
+            }
+            return 0;
+         }
+         ftdi_usb_close(context);
+      }
+
+      int ftdi_status = ftdi_usb_open_desc(context, vendor, product, NULL, serial);
+      if(ftdi_status != 0){
+         return ftdi_status;
+      }
+      if(deviceIdOf(context, &id)){
+         for(size_t i = 0; i < ids.size(); i++){
+            if(ids[i].serial == id.serial){
+               ids.erase(ids.begin() + i);
+               break;
+            }
+         }
+         ids.insert(ids.begin(), id);
+         saveDeviceCache(ids);
+      }
+      return 0;
+   }
+}
+
+#endif
@@ -0,0 +1,116 @@
+// Both MPSSE engines of an FT2232H/FT4232H in parallel: interface A streams the
+// DAC writes and interface B the ADC frames, each with its own command stream
+// and endpoints, so neither spends SK clocks on the other's SPI traffic. The two
+// frames are padded to the same period in the MPSSE timing model and the streams
+// are started back to back, so DAC value k and ADC frame k share sample index k.
+//
+// The engines share the chip oscillator but not their command timing, so A
+// reads the pins back every dualTickFrames frames, the frame ahead of each read
+// padded that much shorter: fitting a TimeBase to those ticks and one to B's
+// reads gives the start skew, which writeMerged takes out, and any rate mismatch.
+
+#ifndef OSCI_DUAL_HPP
+#define OSCI_DUAL_HPP
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+#include <osci/board.hpp>
+#include <osci/scanlist.hpp>
+
+namespace Osci{
+   const int32_t dualTickFrames = 256; // frames between pin reads on interface A
+   const int32_t dacFrameClocks = dacWriteClocks + setBitsClocks; // DAC write and CS release
+   const int32_t tickClocks = cmdGapClocks; // GET_BITS_LOW: no SK clocks, only its decode
+   const int32_t padMaxClocks = 8*0x10000; // one CLK_BYTES command
+
+   // Whether padClocks can idle exactly clocks SK clocks: nothing for 0, one clock
+   // command, or two (whole bytes and the odd bits, or two bit runs)
+   inline bool padFits(int32_t clocks){
+      if(clocks == 0) return true;
+      int32_t n = clocks - cmdGapClocks;
+      if(n >= 1 && (n < 8 || n % 8 == 0) && n <= padMaxClocks) return true;
+      n -= cmdGapClocks;
+      return n >= 2 && n <= padMaxClocks;
+   }
+
+   // Idle commands costing exactly clocks SK clocks in the timing model. Returns
+   // false, appending nothing, if padFits(clocks) is false.
+   inline bool padClocks(uint8_t* buf, int32_t* iWrite, int32_t clocks){
+      if(!padFits(clocks)) return false;
+      if(clocks == 0) return true;
+      int32_t n = clocks - cmdGapClocks;
+      if(n >= 1 && (n < 8 || n % 8 == 0) && n <= padMaxClocks){
+         idleClocks(buf, iWrite, n);
+         return true;
+      }
+      n -= cmdGapClocks;
+      int32_t bits = n > 8 ? (n - 1) % 8 + 1 : n/2;
+      idleClocks(buf, iWrite, n - bits);
+      idleClocks(buf, iWrite, bits);
+      return true;
+   }
+
+   // Timing tick on A: one byte of pins read back
+   inline void appendTick(uint8_t* buf, int32_t* iWrite, int32_t* iRead){
+      buf[(*iWrite)++] = GET_BITS_LOW; // opcode: read low bits (ADBUS[0-7])
+      (*iRead)++;
+   }
+
+   // Per-sample command frames of both engines, padded to a common period
+   struct DualFrames{
+      std::vector<uint8_t> dacTail;     // A, after the DAC write: CS release and padding
+      std::vector<uint8_t> dacTickTail; // A, every dualTickFrames frames: shorter padding and the tick
+      std::vector<uint8_t> adc;         // B: the ADC reads, CS release and padding
+      int32_t period = 0;               // SK clocks per frame on both engines
+   };
+
+   // scan must be compiled with leadClocks = setBitsClocks (its CS release). The
+   // period is the longer frame, lengthened until every frame pads to it exactly.
+   inline DualFrames dualFrames(const ScanList& scan){
+      DualFrames f;
+      f.period = scan.frameClocks() > dacFrameClocks + tickClocks ? scan.frameClocks() : dacFrameClocks + tickClocks;
+      while(!padFits(f.period - dacFrameClocks) || !padFits(f.period - dacFrameClocks - tickClocks)
+            || !padFits(f.period - scan.frameClocks())){
+         f.period++;
+      }
+      std::vector<uint8_t> buf(scan.frameBytes() + releaseCmdBytes + 6);
+      int32_t n = 0, reads = 0;
+      releaseCs(buf.data(), &n);
+      padClocks(buf.data(), &n, f.period - dacFrameClocks);
+      f.dacTail.assign(buf.begin(), buf.begin() + n);
+      n = 0;
+      releaseCs(buf.data(), &n);
+      padClocks(buf.data(), &n, f.period - dacFrameClocks - tickClocks);
+      appendTick(buf.data(), &n, &reads);
+      f.dacTickTail.assign(buf.begin(), buf.begin() + n);
+      n = 0;
+      reads = 0;
+      scan.append(buf.data(), &n, &reads);
+      releaseCs(buf.data(), &n);
+      padClocks(buf.data(), &n, f.period - scan.frameClocks());
+      f.adc.assign(buf.begin(), buf.begin() + n);
+      return f;
+   }
+
+   // One row per ADC frame: index, DAC code, then the ADC columns. A started
+   // skewFrames frames after B, so ADC frame f saw DAC value f - skewFrames;
+   // frames without a DAC value are left out. Returns the rows written.
+   inline int32_t writeMerged(std::ostream& out, const uint16_t* dac, const uint16_t* adc, int32_t nFrames, int reads,
+                              int32_t skewFrames = 0){
+      int32_t rows = 0;
+      for(int32_t f = 0; f < nFrames; f++){
+         int64_t k = (int64_t) f - skewFrames;
+         if(k < 0 || k >= nFrames) continue;
+         out << f << "; " << dac[k];
+         for(int c = 0; c < reads; c++){
+            out << "; " << adc[(size_t)f*reads + c];
+         }
+         out << '\n';
+         rows++;
+      }
+      return rows;
+   }
+}
+
+#endif
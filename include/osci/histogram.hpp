@@ -0,0 +1,77 @@
+// Latency histogram for loop and round-trip timing, in microseconds.
+// Bins are binWidth wide up to nBins*binWidth; longer samples land in the last bin.
+
+#ifndef OSCI_HISTOGRAM_HPP
+#define OSCI_HISTOGRAM_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <ostream>
+#include <vector>
+
+namespace Osci{
+   class LatencyHistogram{
+   public:
+      LatencyHistogram(double binWidth = 25.0, int nBins = 200)
+         : binWidth_(binWidth), bins_(nBins, 0){}
+
+      void add(double us){
+         int b = (int) (us/binWidth_);
+         if(b < 0) b = 0;
+         if(b >= (int) bins_.size()) b = bins_.size() - 1;
+         bins_[b]++;
+         n_++;
+         sum_ += us;
+         sumSq_ += us*us;
+         if(n_ == 1 || us < min_) min_ = us;
+         if(us > max_) max_ = us;
+      }
+
+      uint64_t count() const{ return n_; }
+      double mean() const{ return n_ ? sum_/n_ : 0; }
+      double min() const{ return min_; }
+      double max() const{ return max_; }
+      double jitter() const{ // standard deviation
+         if(n_ < 2) return 0;
+         double m = mean();
+         return sqrt((sumSq_ - n_*m*m)/(n_ - 1));
+      }
+
+      // Upper edge of the bin containing the given fraction of the samples
+      double percentile(double p) const{
+         uint64_t target = (uint64_t) ceil(p*n_);
+         uint64_t acc = 0;
+         for(size_t b = 0; b < bins_.size(); b++){
+            acc += bins_[b];
+            if(acc >= target && acc > 0) return (b+1)*binWidth_;
+         }
+         return bins_.size()*binWidth_;
+      }
+
+      void reset(){
+         for(auto& b : bins_) b = 0;
+         n_ = 0;
+         sum_ = sumSq_ = min_ = max_ = 0;
+      }
+
+      // Summary line followed by the non-empty bins
+      void print(std::ostream& out) const{
+         out << "n=" << n_ << " mean=" << mean() << "us jitter=" << jitter() << "us min=" << min_
+             << "us p50=" << percentile(0.5) << "us p99=" << percentile(0.99) << "us max=" << max_ << "us\n";
+         for(size_t b = 0; b < bins_.size(); b++){
+            if(bins_[b] == 0) continue;
+            out << "  " << b*binWidth_ << (b == bins_.size()-1 ? "+" : "-" ) ;
+            if(b != bins_.size()-1) out << (b+1)*binWidth_;
+            out << "us: " << bins_[b] << '\n';
+         }
+      }
+
+   private:
+      double binWidth_;
+      std::vector<uint64_t> bins_;
+      uint64_t n_ = 0;
+      double sum_ = 0, sumSq_ = 0, min_ = 0, max_ = 0;
+   };
+}
+
+#endif
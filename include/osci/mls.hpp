@@ -0,0 +1,162 @@
+// Impulse response by maximum-length sequence. The DAC plays an MLS of order m
+// (period L = 2^m - 1, two levels) over and over; once the circuit is in periodic
+// steady state every period of a column is the circular convolution of its
+// impulse response with the sequence, and the circular correlation with the
+// sequence recovers it: the MLS autocorrelation is L+1 at lag 0 and -1 elsewhere.
+//
+// The correlation is done with a fast Hadamard transform (Borish & Angell) in
+// O(L log L): the window of m bits following sample n is a nonzero m-bit vector,
+// every later sample a parity of it, so permuting the period by those vectors
+// turns the correlation into a Walsh-Hadamard transform of length 2^m.
+//
+// Averaging is linear, so periods are summed in the time domain as they stream
+// in and the transform runs once on the mean.
+//
+// The sequence sums to -1 over a period, so a constant offset on the response
+// can't be told apart from the DC gain: the period mean is taken out before the
+// correlation, which leaves every tap short by sum(h)/L and the DC gain unknown.
+// Bin 0 of the frequency response carries no information.
+
+#ifndef OSCI_MLS_HPP
+#define OSCI_MLS_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#include <vector>
+#include <osci/decimate.hpp>
+#include <osci/spectrum.hpp>
+
+namespace Osci{
+   const int mlsMinOrder = 3;
+   const int mlsMaxOrder = 24;
+
+   // Feedback taps (1-based, maximal length) per order, zero terminated
+   const uint8_t mlsTaps[mlsMaxOrder + 1][5] = {
+      {0}, {0}, {0},
+      {3, 2, 0}, {4, 3, 0}, {5, 3, 0}, {6, 5, 0}, {7, 6, 0}, {8, 6, 5, 4, 0},
+      {9, 5, 0}, {10, 7, 0}, {11, 9, 0}, {12, 6, 4, 1, 0}, {13, 4, 3, 1, 0},
+      {14, 5, 3, 1, 0}, {15, 14, 0}, {16, 15, 13, 4, 0}, {17, 14, 0}, {18, 11, 0},
+      {19, 6, 2, 1, 0}, {20, 17, 0}, {21, 19, 0}, {22, 21, 0}, {23, 18, 0}, {24, 23, 22, 17, 0}
+   };
+
+   class Mls{
+   public:
+      explicit Mls(int order) : order_(order), length_((1 << order) - 1),
+                                bits_(length_), in_(length_), out_(length_), work_(1 << order){
+         // s[n+m] = XOR of s[n+m-t] over the taps t, seeded with a single one
+         for(int32_t n = 0; n < length_; n++){
+            if(n < order){
+               bits_[n] = n == 0;
+               continue;
+            }
+            uint8_t b = 0;
+            for(int i = 0; mlsTaps[order][i] != 0; i++) b ^= bits_[n - mlsTaps[order][i]];
+            bits_[n] = b;
+         }
+         // Window after sample n, and the mask u_k with s[n+k] = parity(u_k & window(n))
+         std::vector<uint32_t> u(length_);
+         for(int32_t k = 0; k < length_; k++){
+            if(k < order){
+               u[k] = 1u << k;
+               continue;
+            }
+            uint32_t v = 0;
+            for(int i = 0; mlsTaps[order][i] != 0; i++) v ^= u[k - mlsTaps[order][i]];
+            u[k] = v;
+         }
+         for(int32_t n = 0; n < length_; n++){
+            uint32_t w = 0;
+            for(int i = 0; i < order; i++) w |= (uint32_t) bits_[(n + i) % length_] << i;
+            in_[n] = w;
+         }
+         // Lag k correlates with s[n-k] = s[n + L-k]
+         for(int32_t k = 0; k < length_; k++) out_[k] = u[(length_ - k) % length_];
+      }
+
+      int order() const{ return order_; }
+      int32_t length() const{ return length_; }
+      // Sequence value n as +1 (bit 0) or -1 (bit 1)
+      int level(int32_t n) const{ return bits_[n] ? -1 : 1; }
+
+      // Impulse response of one steady-state period y (of the response to level()),
+      // h[k] - sum(h)/L for k = 0..L-1, whatever the offset of y
+      void impulse(const double* y, double* h){
+         double mean = 0;
+         for(int32_t n = 0; n < length_; n++) mean += y[n];
+         mean /= length_;
+         work_[0] = 0;
+         for(int32_t n = 0; n < length_; n++) work_[in_[n]] = y[n] - mean;
+         hadamard(work_.data(), (int32_t) work_.size());
+         // Correlation of the zero-mean period: (L+1)(h[k] - sum(h)/L)
+         for(int32_t k = 0; k < length_; k++) h[k] = work_[out_[k]]/(length_ + 1);
+      }
+
+   private:
+      static void hadamard(double* x, int32_t n){
+         for(int32_t len = 1; len < n; len <<= 1){
+            for(int32_t i = 0; i < n; i += 2*len){
+               for(int32_t j = i; j < i + len; j++){
+                  double a = x[j], b = x[j + len];
+                  x[j] = a + b;
+                  x[j + len] = a - b;
+               }
+            }
+         }
+      }
+
+      int order_;
+      int32_t length_;
+      std::vector<uint8_t> bits_;
+      std::vector<uint32_t> in_, out_; // input permutation, output lag to Hadamard index
+      std::vector<double> work_;
+   };
+
+   // Running sum of whole periods per column of interleaved frames, skipping the first
+   // periods while the circuit settles into the periodic steady state
+   class MlsAverager{
+   public:
+      MlsAverager(int32_t length, int columns, int skipPeriods = 1)
+         : length_(length), columns_(columns), skip_((int64_t) skipPeriods*length), acc_((size_t)length*columns, 0.0){}
+
+      // Feed nFrames frames of columns ADC codes, in stream order
+      void process(const uint16_t* adc, int32_t nFrames){
+         int32_t f = 0;
+         for(; f < nFrames && skip_ > 0; f++) skip_--;
+         for(; f < nFrames; f++){
+            double* a = acc_.data() + (size_t)pos_*columns_;
+            for(int c = 0; c < columns_; c++) a[c] += adcSigned(adc[(size_t)f*columns_ + c]);
+            if(++pos_ == length_){
+               pos_ = 0;
+               periods_++;
+            }
+         }
+      }
+
+      int periods() const{ return periods_; }
+
+      // Mean period of column c, in ADC codes
+      void mean(int c, double* y) const{
+         for(int32_t n = 0; n < length_; n++) y[n] = periods_ > 0 ? acc_[(size_t)n*columns_ + c]/periods_ : 0;
+      }
+
+   private:
+      int32_t length_;
+      int columns_;
+      int64_t skip_;
+      int32_t pos_ = 0;
+      int periods_ = 0;
+      std::vector<double> acc_;
+   };
+
+   // Frequency response of an impulse response, zero padded to fft.size() (bins 0..n/2)
+   inline std::vector<std::complex<double>> frequencyResponse(const double* h, int32_t length, const Fft& fft){
+      std::vector<std::complex<double>> x(fft.size(), 0.0);
+      for(int32_t k = 0; k < length && k < fft.size(); k++) x[k] = h[k];
+      fft.forward(x.data());
+      x.resize(fft.size()/2 + 1);
+      return x;
+   }
+}
+
+#endif
@@ -0,0 +1,210 @@
+// TCP streaming of decoded sample blocks, trigger events and spectra.
+//
+// The server runs its own asio io_context thread. publish*() may be called from
+// the acquisition thread: it wraps the block in a shared buffer and hands it to
+// every client's bounded queue. Writes are scatter-gather (header + block buffer),
+// so blocks are never copied per client. A client that falls behind gets its
+// queued sample blocks decimated. Trigger events are kept up to netMaxTriggers,
+// then the oldest are dropped, and a queued spectrum is replaced by the newer one
+// of its column. Gaps show up as jumps in the message sequence number.
+
+#ifndef OSCI_NETSERVER_HPP
+#define OSCI_NETSERVER_HPP
+
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <osci/postprocess.hpp>
+
+namespace Osci{
+   const uint16_t netPort = 5025;
+   const size_t netMaxQueue = 64;       // sample blocks queued per client before decimating
+   const size_t netMaxTriggers = 1024;  // trigger events queued per client before dropping
+   const uint32_t netMaxPayload = 1u << 26; // bytes, anything larger is a corrupt stream
+
+   enum netMsg{
+      MSG_SAMPLES = 1,  // uint16_t samples, frames x channels interleaved
+      MSG_TRIGGER = 2,  // no payload, channel and frame in the header
+      MSG_SPECTRUM = 3  // float RMS magnitudes in ADC codes, bins 0..n/2 of the averaged spectrum
+   };
+
+   // Little-endian wire header, followed by bytes of payload
+   struct NetHeader{
+      uint32_t type;
+      uint32_t channel;  // channel count for MSG_SAMPLES, channel index otherwise
+      uint64_t seq;      // per-server message sequence number
+      uint64_t frame;    // first frame of the block, or the trigger/spectrum frame
+      uint32_t bytes;
+      uint32_t pad;
+   };
+
+   // Checks a header received from the network before its payload is read or used
+   inline bool validHeader(const NetHeader& hdr){
+      if(hdr.bytes > netMaxPayload) return false;
+      switch(hdr.type){
+      case MSG_SAMPLES: return hdr.channel > 0 && hdr.bytes % sizeof(uint16_t) == 0
+                            && (hdr.bytes/sizeof(uint16_t)) % hdr.channel == 0;
+      case MSG_TRIGGER: return hdr.bytes == 0;
+      case MSG_SPECTRUM: return hdr.bytes % sizeof(float) == 0;
+      default: return true; // unknown types are skipped
+      }
+   }
+
+   struct NetMessage{
+      NetHeader hdr;
+      std::vector<uint8_t> payload;
+   };
+
+   class NetServer{
+   public:
+      explicit NetServer(uint16_t port = netPort)
+         : work_(boost::asio::make_work_guard(io_)),
+           acceptor_(io_, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)){
+         accept();
+         thread_ = std::thread([this]{ io_.run(); });
+      }
+
+      ~NetServer(){
+         boost::asio::post(io_, [this]{
+            boost::system::error_code ec;
+            acceptor_.close(ec);
+            for(auto& s : sessions_) s->socket.close(ec);
+            sessions_.clear();
+         });
+         work_.reset();
+         thread_.join();
+      }
+
+      uint16_t port() const{ return acceptor_.local_endpoint().port(); }
+
+      // Send nFrames decoded frames of channels samples as one MSG_SAMPLES block
+      void publishSamples(const uint16_t* samples, int32_t nFrames, int channels = nAdc){
+         auto msg = std::make_shared<NetMessage>();
+         msg->payload.assign((const uint8_t*) samples, (const uint8_t*) (samples + (size_t)nFrames*channels));
+         send(msg, MSG_SAMPLES, channels, frames_);
+         frames_ += nFrames;
+      }
+
+      void publishTrigger(uint32_t channel, uint64_t frame){
+         send(std::make_shared<NetMessage>(), MSG_TRIGGER, channel, frame);
+      }
+
+      void publishSpectrum(uint32_t channel, uint64_t frame, const float* bins, size_t nBins){
+         auto msg = std::make_shared<NetMessage>();
+         msg->payload.assign((const uint8_t*) bins, (const uint8_t*) (bins + nBins));
+         send(msg, MSG_SPECTRUM, channel, frame);
+      }
+
+      // Wait until every client has received its queue, or the timeout expires
+      void drain(std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)){
+         auto end = std::chrono::steady_clock::now() + timeout;
+         while(std::chrono::steady_clock::now() < end){
+            std::promise<bool> idle;
+            boost::asio::post(io_, [this, &idle]{
+               bool empty = true;
+               for(auto& s : sessions_) empty = empty && s->queue.empty();
+               idle.set_value(empty);
+            });
+            if(idle.get_future().get()) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         }
+      }
+
+   private:
+      struct Session{
+         explicit Session(boost::asio::ip::tcp::socket s) : socket(std::move(s)){}
+         boost::asio::ip::tcp::socket socket;
+         std::deque<std::shared_ptr<const NetMessage>> queue; // front is being written
+         uint64_t dropped = 0;         // sample blocks
+         uint64_t droppedTriggers = 0;
+         uint64_t replacedSpectra = 0;
+      };
+
+      void accept(){
+         acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket){
+            if(ec) return; // acceptor closed
+            socket.set_option(boost::asio::ip::tcp::no_delay(true));
+            sessions_.insert(std::make_shared<Session>(std::move(socket)));
+            accept();
+         });
+      }
+
+      void send(std::shared_ptr<NetMessage> msg, uint32_t type, uint32_t channel, uint64_t frame){
+         msg->hdr.type = type;
+         msg->hdr.channel = channel;
+         msg->hdr.seq = seq_++;
+         msg->hdr.frame = frame;
+         msg->hdr.bytes = (uint32_t) msg->payload.size();
+         msg->hdr.pad = 0;
+         std::shared_ptr<const NetMessage> m = std::move(msg);
+         boost::asio::post(io_, [this, m]{
+            for(auto& s : sessions_) enqueue(s, m);
+         });
+      }
+
+      // Each message type is bounded on its own; the front is in flight and never touched
+      void enqueue(const std::shared_ptr<Session>& s, const std::shared_ptr<const NetMessage>& m){
+         size_t samples = 0, triggers = 0;
+         auto firstTrigger = s->queue.end(), sameSpectrum = s->queue.end();
+         for(auto it = s->queue.begin() + (s->queue.empty() ? 0 : 1); it != s->queue.end(); ++it){
+            const NetHeader& hdr = (*it)->hdr;
+            if(hdr.type == MSG_SAMPLES) samples++;
+            if(hdr.type == MSG_TRIGGER && triggers++ == 0) firstTrigger = it;
+            if(hdr.type == MSG_SPECTRUM && hdr.channel == m->hdr.channel) sameSpectrum = it;
+         }
+         if(m->hdr.type == MSG_SAMPLES && samples >= netMaxQueue){
+            // Slow client: keep every other queued sample block
+            bool odd = false;
+            for(auto it = s->queue.begin() + 1; it != s->queue.end();){
+               if((*it)->hdr.type == MSG_SAMPLES && (odd = !odd)){
+                  it = s->queue.erase(it);
+                  s->dropped++;
+               }else{
+                  ++it;
+               }
+            }
+         }else if(m->hdr.type == MSG_TRIGGER && triggers >= netMaxTriggers){
+            s->queue.erase(firstTrigger);
+            s->droppedTriggers++;
+         }else if(m->hdr.type == MSG_SPECTRUM && sameSpectrum != s->queue.end()){
+            s->queue.erase(sameSpectrum); // superseded by the running average in m
+            s->replacedSpectra++;
+         }
+         s->queue.push_back(m);
+         if(s->queue.size() == 1) write(s);
+      }
+
+      void write(const std::shared_ptr<Session>& s){
+         const NetMessage& m = *s->queue.front();
+         std::array<boost::asio::const_buffer, 2> bufs = {
+            boost::asio::buffer(&m.hdr, sizeof(m.hdr)),
+            boost::asio::buffer(m.payload)
+         };
+         boost::asio::async_write(s->socket, bufs, [this, s](boost::system::error_code ec, size_t){
+            if(ec){
+               sessions_.erase(s); // client went away
+               return;
+            }
+            s->queue.pop_front();
+            if(!s->queue.empty()) write(s);
+         });
+      }
+
+      boost::asio::io_context io_;
+      boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+      boost::asio::ip::tcp::acceptor acceptor_;
+      std::set<std::shared_ptr<Session>> sessions_; // only touched on the io thread
+      std::thread thread_;
+      uint64_t seq_ = 0;    // only touched by the publishing thread
+      uint64_t frames_ = 0;
+   };
+}
+
+#endif
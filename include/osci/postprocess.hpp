@@ -0,0 +1,116 @@
+// Post-processing of the raw MPSSE read buffer: decode, convert, format.
+// Large captures are split on frame boundaries across worker threads and
+// stitched back in order, so the output is identical to the serial path.
+
+#ifndef OSCI_POSTPROCESS_HPP
+#define OSCI_POSTPROCESS_HPP
+
+#include <stdint.h>
+#include <charconv>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Osci{
+   const int nAdc = 3;                  // ADC0..2 are read for every sample
+   const int frameSize = 2*nAdc;        // 12 bits on 2 bytes per ADC
+   const int maxReads = 64;             // ADC reads per frame with a scan list
+   const int32_t minFramesPerWorker = 65536; // below this, threads cost more than they save
+
+   // Decode one frame into its ADC values (the MSB of the second byte is irrelevant)
+   inline void decodeFrame(const uint8_t* frame, uint16_t* adc, int reads = nAdc){
+      for(int c = 0; c < reads; c++){
+         adc[c] = (((uint16_t) frame[2*c]) << 4) + (frame[2*c+1] & 0x0F);
+      }
+   }
+
+   // Decode nFrames frames into interleaved ADC values (reads per frame)
+   inline void decodeFrames(const uint8_t* readBuf, int32_t nFrames, uint16_t* adc, int reads = nAdc){
+      for(int32_t f = 0; f < nFrames; f++){
+         decodeFrame(readBuf + (size_t)f*2*reads, adc + (size_t)f*reads, reads);
+      }
+   }
+
+   // Convert Dacx0501 12bit 2-complement output to volts
+   inline float outToVolt(uint16_t out){
+      uint16_t sign = out&0x800;
+      float ret = -1.0*sign + 1.0*(out&0x7FF);
+      ret = (((ret+2048.0)/4095.0)*5.0)-2.5;
+      return ret;
+   }
+
+   // Result of one worker: formatted csv lines and the partial ADC0 sum
+   struct Chunk{
+      std::string text;
+      float voltSum = 0;
+   };
+
+   // Decode, convert and format frames [first, last) of readBuf
+   inline void processFrames(const uint8_t* readBuf, int32_t first, int32_t last, Chunk* chunk, int reads = nAdc){
+      chunk->text.clear();
+      chunk->text.reserve((size_t)(last-first)*6*reads); // "dddd; dddd; dddd\n"
+      chunk->voltSum = 0;
+      char line[6*maxReads];
+      for(int32_t f = first; f < last; f++){
+         uint16_t adc[maxReads];
+         decodeFrame(readBuf + (size_t)f*2*reads, adc, reads);
+         char* p = line;
+         for(int c = 0; c < reads; c++){
+            p = std::to_chars(p, line + sizeof(line), adc[c]).ptr;
+            if(c < reads-1){
+               *p++ = ';';
+               *p++ = ' ';
+            }
+         }
+         *p++ = '\n';
+         chunk->text.append(line, p - line);
+         if (f >= 1){ // the first value read not always reliable
+            chunk->voltSum += outToVolt(adc[0]);
+         }
+      }
+   }
+
+   // Decode nRead bytes of readBuf into out (csv, one frame per line) using up to
+   // nThreads workers (0: one per hardware thread). Returns the sum of the first
+   // read of every frame in volts, skipping the first frame.
+   inline float postProcess(const uint8_t* readBuf, int32_t nRead, std::ostream& out, unsigned int nThreads = 0, int reads = nAdc){
+      int32_t nFrames = nRead/(2*reads);
+      if(nThreads == 0){
+         nThreads = std::thread::hardware_concurrency();
+      }
+      if(nThreads == 0){
+         nThreads = 1;
+      }
+      int32_t maxWorkers = nFrames/minFramesPerWorker;
+      if((int32_t) nThreads > maxWorkers){
+         nThreads = maxWorkers > 1 ? maxWorkers : 1;
+      }
+
+      std::vector<Chunk> chunks(nThreads);
+      std::vector<std::thread> workers;
+      int32_t perWorker = nFrames/nThreads;
+      for(unsigned int w = 0; w < nThreads; w++){
+         int32_t first = w*perWorker;
+         int32_t last = (w == nThreads-1) ? nFrames : first + perWorker;
+         if(w == nThreads-1){
+            processFrames(readBuf, first, last, &chunks[w], reads); // the calling thread takes the last slice
+         }else{
+            workers.emplace_back(processFrames, readBuf, first, last, &chunks[w], reads);
+         }
+      }
+      for(auto& t : workers){
+         t.join();
+      }
+
+      // Stitch the results in order
+      float res = 0;
+      for(auto& c : chunks){
+         out.write(c.text.data(), c.text.size());
+         res += c.voltSum;
+      }
+      return res;
+   }
+}
+
+#endif
@@ -0,0 +1,121 @@
+// Single-shot sampling: fetch one fresh ADC0..2 sample set on demand.
+//
+// The LTC230x returns the conversion started by the previous chip select release,
+// so each frame first pulses every chip select to start a conversion, waits the
+// conversion time in idle clocks and only then reads: the values returned were
+// converted within the round trip (after the DAC write, if any), not at the end
+// of the previous call.
+//
+// The command frames are built once and end with SEND_IMMEDIATE, the latency
+// timer is set to 1 ms and the chunk sizes to one high-speed packet, so a
+// request completes in a few USB microframes instead of waiting for the default
+// 16 ms timer or the giant capture buffers. Every round trip is timed.
+
+#ifndef OSCI_SAMPLER_HPP
+#define OSCI_SAMPLER_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <libftdi/ftdi.h>
+#include <osci/board.hpp>
+#include <osci/histogram.hpp>
+#include <osci/postprocess.hpp>
+#include <osci/scanlist.hpp>
+
+namespace Osci{
+   const unsigned char shotLatencyTimer = 1;  // ms
+   const unsigned int shotChunkSize = 512;    // one high-speed packet
+   const int shotMaxEmptyReads = 1000;        // give up after ~1 s of packets without data
+   const int32_t shotConvertBytes = nAdc*2*releaseCmdBytes + 5; // CS pulses and the idle clocks
+
+   class SingleShot{
+   public:
+      // The context must be open and in MPSSE mode (see openMpsse and setupMpsse), with
+      // the SK clock divisor given here. The conversions started by the first call use
+      // the config last sent to each ADC, so the first values may be discarded.
+      explicit SingleShot(struct ftdi_context* context, uint8_t adcConfig = 0x00, uint8_t readEdge = 0,
+                          uint16_t divisor = 0x0000)
+         : context_(context), roundTrip_(10.0, 500){
+         int32_t iRead = 0;
+         readLen_ = 0;
+         // Convert: pulse each chip select, then wait for the slowest conversion
+         for(int c = 0; c < nAdc; c++){
+            readCmd_[readLen_++] = SET_BITS_LOW; // opcode: set low bits (ADBUS[0-7])
+            readCmd_[readLen_++] = Ft232::pinInitialState & ~Ft232::adcCs[c]; // argument: select ADC
+            readCmd_[readLen_++] = Ft232::pinDirection; // argument: pin direction
+            releaseCs(readCmd_, &readLen_); // the rising edge starts the conversion
+         }
+         idleClocks(readCmd_, &readLen_, (int32_t) ceil(AdcTiming().convNs/skPeriodNs(divisor)));
+         // Read
+         for(int c = 0; c < nAdc; c++){
+            readAdc(readCmd_, &readLen_, &iRead, Ft232::adcCs[c], adcConfig, readEdge);
+         }
+         releaseCs(readCmd_, &readLen_);
+         readCmd_[readLen_++] = SEND_IMMEDIATE; // opcode: flush the read data to the host now
+
+         // Same frame preceded by a DAC write
+         dacLen_ = 0;
+         writeDac(dacCmd_, &dacLen_, 0);
+         memcpy(dacCmd_ + dacLen_, readCmd_, readLen_);
+         dacLen_ += readLen_;
+      }
+
+      // Configure the context for short round trips. Returns 0 or a libftdi error code.
+      int init(){
+         int ret = ftdi_set_latency_timer(context_, shotLatencyTimer);
+         if(ret == 0) ret = ftdi_write_data_set_chunksize(context_, shotChunkSize);
+         if(ret == 0) ret = ftdi_read_data_set_chunksize(context_, shotChunkSize);
+         return ret;
+      }
+
+      // Convert and read ADC0..2. Returns 0, or -1 if the transfer failed.
+      int sample(uint16_t* adc){
+         return transfer(readCmd_, readLen_, adc);
+      }
+
+      // Write the DAC, then convert and read ADC0..2 in the same round trip
+      int sample(uint16_t dacVal, uint16_t* adc){
+         dacCmd_[dacMsb] = (uint8_t) (((dacVal & 0x0FF0) >> 4) & 0x00FF);
+         dacCmd_[dacLsb] = (uint8_t) ((dacVal & 0x000F) << 4);
+         return transfer(dacCmd_, dacLen_, adc);
+      }
+
+      const LatencyHistogram& roundTrip() const{ return roundTrip_; }
+      LatencyHistogram& roundTrip(){ return roundTrip_; }
+
+   private:
+      static const int32_t dacMsb = 7, dacLsb = 8; // offsets of the DAC value in dacCmd_
+
+      int transfer(const uint8_t* cmd, int32_t len, uint16_t* adc){
+         auto t0 = std::chrono::steady_clock::now();
+         if(ftdi_write_data(context_, cmd, len) != len){
+            return -1;
+         }
+         int32_t got = 0;
+         int empty = 0;
+         while(got < frameSize && empty < shotMaxEmptyReads){
+            int r = ftdi_read_data(context_, readBuf_ + got, frameSize - got);
+            if(r < 0) return -1;
+            if(r == 0) empty++;
+            got += r;
+         }
+         if(got != frameSize){
+            return -1;
+         }
+         roundTrip_.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+         decodeFrame(readBuf_, adc);
+         return 0;
+      }
+
+      struct ftdi_context* context_;
+      uint8_t readCmd_[shotConvertBytes + nAdc*adcCmdBytes + releaseCmdBytes + 1];
+      uint8_t dacCmd_[dacCmdBytes + shotConvertBytes + nAdc*adcCmdBytes + releaseCmdBytes + 1];
+      int32_t readLen_, dacLen_;
+      uint8_t readBuf_[frameSize];
+      LatencyHistogram roundTrip_;
+   };
+}
+
+#endif
@@ -0,0 +1,279 @@
+// ADC scan lists compiled into the per-sample command frame.
+//
+// Each entry selects an ADC (chip select), its input mux and polarity, and a
+// rate: an entry with rate r is read r times per frame, spread evenly over the
+// frame. Disabled entries and unused ADCs cost nothing, so dropping channels
+// raises the sample rate of the remaining ones.
+//
+// The LTC230x returns the conversion configured by the previous config byte
+// sent to the same chip, so each read slot is attributed to the entry whose
+// config was sent to that ADC before it (wrapping around the frame).
+//
+// A conversion starts when the chip select goes high and the chip can't be
+// read again before it ends, so the frame is scheduled on a model of the
+// MPSSE timing in SK clocks: reads are reordered so an ADC is shifted while
+// the others convert, the chip select is held low until the acquisition time
+// is met, and idle clocks are only inserted when no ADC is ready.
+
+#ifndef OSCI_SCANLIST_HPP
+#define OSCI_SCANLIST_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <osci/board.hpp>
+#include <osci/postprocess.hpp>
+
+namespace Osci{
+   struct ScanEntry{
+      int adc = 0;            // 0..2, chip select CS0..CS2
+      int channel = 0;        // mux input (single-ended) or pair (differential)
+      bool singleEnded = false;
+      bool unipolar = false;
+      int rate = 1;           // reads per frame
+      bool enabled = true;
+
+      // LTC230x config byte: S/D, O/S, S1, S0, UNI
+      uint8_t config() const{
+         uint8_t c = 0;
+         if(singleEnded) c |= Lt230x::SINGLE_ENDED;
+         if(channel & 1) c |= Lt230x::ODD;
+         if(channel & 2) c |= Lt230x::SELECT0;
+         if(channel & 4) c |= Lt230x::SELECT1;
+         if(unipolar) c |= Lt230x::UNIPOLAR;
+         return c;
+      }
+   };
+
+   const double adcMaxTimingNs = 1e6; // longest conversion or acquisition time accepted
+
+   // Converter timing: maximum conversion time, minimum acquisition time
+   struct AdcTiming{
+      double convNs = 1600; // LTC2308
+      double acqNs = 240;
+   };
+
+   class ScanList{
+   public:
+      // ADC0..2, config 0x00, once per frame: the historical frame
+      static ScanList defaults(){
+         ScanList s;
+         for(int a = 0; a < nAdc; a++){
+            ScanEntry e;
+            e.adc = a;
+            s.entries.push_back(e);
+         }
+         return s;
+      }
+
+      // One entry per line: adc channel se|diff uni|bi rate [off]; '#' starts a comment.
+      // "timing adc convNs acqNs" overrides the converter timing of one ADC.
+      // Returns false if the file can't be read or a line is malformed.
+      static bool load(const char* path, ScanList* s){
+         std::ifstream in(path);
+         if(!in) return false;
+         s->entries.clear();
+         std::string line;
+         while(getline(in, line)){
+            line = line.substr(0, line.find('#'));
+            std::istringstream ls(line);
+            ScanEntry e;
+            std::string first, mode, pol, state;
+            if(!(ls >> first)) continue; // blank line
+            if(first == "timing"){
+               AdcTiming t;
+               int adc;
+               if(!(ls >> adc >> t.convNs >> t.acqNs) || adc < 0 || adc >= nAdc) return false;
+               if(!(t.convNs > 0 && t.convNs <= adcMaxTimingNs && t.acqNs >= 0 && t.acqNs <= adcMaxTimingNs)) return false;
+               s->timing[adc] = t;
+               continue;
+            }
+            char* end;
+            e.adc = (int) strtol(first.c_str(), &end, 10);
+            if(end == first.c_str() || *end != '\0') return false; // not a number
+            if(!(ls >> e.channel >> mode >> pol >> e.rate)) return false;
+            if(e.adc < 0 || e.adc >= nAdc || e.channel < 0 || e.channel > 7 || e.rate < 1) return false;
+            if((mode != "se" && mode != "diff") || (pol != "uni" && pol != "bi")) return false;
+            e.singleEnded = (mode == "se");
+            e.unipolar = (pol == "uni");
+            e.enabled = !(ls >> state && state == "off");
+            s->entries.push_back(e);
+         }
+         return true;
+      }
+
+      // Build the frame template for the given SK clock divisor. leadClocks is the
+      // time spent between frames (the DAC write). Returns false if nothing is
+      // enabled or the frame is too long.
+      bool compile(uint8_t readEdge = 0, uint16_t divisor = 0x0000, int32_t leadClocks = dacWriteClocks){
+         std::vector<int> wish;
+         int maxRate = 0;
+         for(auto& e : entries){
+            if(e.enabled && e.rate > maxRate) maxRate = e.rate;
+         }
+         // Spread each entry's reads evenly over maxRate sub-slots
+         for(int k = 0; k < maxRate; k++){
+            for(size_t i = 0; i < entries.size(); i++){
+               const ScanEntry& e = entries[i];
+               if(!e.enabled) continue;
+               if(((k+1)*e.rate)/maxRate > (k*e.rate)/maxRate){
+                  wish.push_back((int) i);
+               }
+            }
+         }
+         if(wish.empty() || (int) wish.size() > maxReads) return false;
+
+         int32_t conv[nAdc], acq[nAdc];
+         for(int a = 0; a < nAdc; a++){
+            conv[a] = (int32_t) ceil(timing[a].convNs/skPeriodNs(divisor));
+            acq[a] = (int32_t) ceil(timing[a].acqNs/skPeriodNs(divisor));
+         }
+
+         // The first pass starts with idle converters, the next ones with the
+         // state left by the previous frame, until the schedule is periodic.
+         int64_t start[nAdc];
+         for(int a = 0; a < nAdc; a++) start[a] = -((int64_t) 1 << 40);
+         for(int pass = 0; pass < 4; pass++){
+            int32_t len = schedule(wish, conv, acq, start, readEdge);
+            if(pass > 0 && len == frameClocks_) break;
+            frameClocks_ = len;
+            for(int a = 0; a < nAdc; a++) start[a] = end_[a] - len - leadClocks;
+         }
+         frameClocks_ += leadClocks;
+
+         // A read returns the conversion set up by the previous config sent to that ADC
+         owner_.assign(slots_.size(), -1);
+         latency_.assign(slots_.size(), 0);
+         for(size_t j = 0; j < slots_.size(); j++){
+            int adc = entries[slots_[j]].adc;
+            for(size_t back = 1; back <= slots_.size(); back++){
+               size_t p = (j + slots_.size() - back) % slots_.size();
+               if(entries[slots_[p]].adc == adc){
+                  owner_[j] = slots_[p];
+                  latency_[j] = p >= j; // config sent in the previous frame
+                  break;
+               }
+            }
+         }
+         return true;
+      }
+
+      // Append one compiled frame of ADC reads
+      void append(uint8_t* buf, int32_t* iWrite, int32_t* iRead) const{
+         memcpy(buf + *iWrite, frame_.data(), frame_.size());
+         *iWrite += frame_.size();
+         *iRead += reads()*adcReadBytes;
+      }
+
+      int reads() const{ return (int) slots_.size(); }
+      int32_t frameBytes() const{ return (int32_t) frame_.size(); }
+      // Estimated cost of a frame including the DAC write, in SK clocks
+      int32_t frameClocks() const{ return frameClocks_; }
+      // Idle clocks inserted to wait for conversions or acquisitions
+      int32_t waitClocks() const{ return idle_; }
+      // Scan entry whose conversion is returned by read slot j
+      int owner(int j) const{ return owner_[j]; }
+      // 1 if that conversion started in the previous frame, so it saw the previous
+      // DAC value, else 0
+      int latency(int j) const{ return latency_[j]; }
+
+      void print(std::ostream& out) const{
+         out << "frame: " << reads() << " reads, " << frameClocks_ << " SK clocks (" << idle_ << " idle)\n";
+         for(int j = 0; j < reads(); j++){
+            const ScanEntry& e = entries[owner_[j]];
+            out << "column " << j << ": ADC" << e.adc << " ch" << e.channel << (e.singleEnded ? " se" : " diff")
+                << (e.unipolar ? " uni" : " bi") << '\n';
+         }
+      }
+
+      std::vector<ScanEntry> entries;
+      AdcTiming timing[nAdc];
+
+   private:
+      // Greedy list scheduling of the wished reads: take the first read whose ADC
+      // is ready, else the one that is ready soonest. start holds the clock at
+      // which each ADC started converting; the frame length is returned and the
+      // clock at which each ADC was left converting is stored in end_.
+      int32_t schedule(const std::vector<int>& wish, const int32_t* conv, const int32_t* acq, const int64_t* start0,
+                       uint8_t readEdge){
+         int64_t start[nAdc];
+         for(int a = 0; a < nAdc; a++) start[a] = start0[a];
+         // A slot waits at most four times (three settles and a conversion), none longer
+         // than the longest conversion or acquisition, and a wait is one CLK_BYTES per
+         // 0x10000 bytes of clocks plus a CLK_BITS
+         int32_t longest = 0;
+         for(int a = 0; a < nAdc; a++) longest = std::max(longest, std::max(conv[a], acq[a]));
+         size_t waitBytes = 3*((size_t)longest/8/0x10000 + 1) + 2;
+         std::vector<uint8_t> buf(wish.size()*(adcCmdBytes + releaseCmdBytes + 4*waitBytes) + waitBytes);
+         int32_t iWrite = 0, iRead = 0;
+         std::vector<int> left(wish);
+         slots_.clear();
+         idle_ = 0;
+         int64_t t = 0, muxAt = 0;
+         int sel = -1; // ADC with its chip select low
+         auto ready = [&](int a){ return a == sel ? t + setBitsClocks + conv[a] : start[a] + conv[a]; };
+         auto settle = [&](){ // hold the selected ADC until its acquisition is done
+            if(sel >= 0 && t - muxAt < acq[sel]){
+               int32_t c = idleClocks(buf.data(), &iWrite, (int32_t) (acq[sel] - (t - muxAt)));
+               t += c;
+               idle_ += c;
+            }
+         };
+
+         while(!left.empty()){
+            size_t pick = 0;
+            for(size_t k = 0; k < left.size(); k++){
+               if(ready(entries[left[k]].adc) < ready(entries[left[pick]].adc)) pick = k;
+               if(ready(entries[left[k]].adc) <= t){
+                  pick = k;
+                  break;
+               }
+            }
+            int a = entries[left[pick]].adc;
+            if(a == sel){ // the same ADC again: release it to start its conversion
+               settle();
+               releaseCs(buf.data(), &iWrite);
+               t += setBitsClocks;
+               start[a] = t;
+               sel = -1;
+            }
+            if(start[a] + conv[a] > t){
+               settle();
+               int32_t c = idleClocks(buf.data(), &iWrite, (int32_t) (start[a] + conv[a] - t));
+               t += c;
+               idle_ += c;
+            }
+            settle();
+            readAdc(buf.data(), &iWrite, &iRead, Ft232::adcCs[a], entries[left[pick]].config(), readEdge);
+            if(sel >= 0) start[sel] = t + setBitsClocks;
+            muxAt = t + adcMuxClocks;
+            t += adcReadClocks;
+            sel = a;
+            slots_.push_back(left[pick]);
+            left.erase(left.begin() + pick);
+         }
+         settle(); // the DAC write that follows releases the last ADC
+         start[sel] = t + setBitsClocks;
+         for(int a = 0; a < nAdc; a++) end_[a] = start[a];
+         frame_.assign(buf.begin(), buf.begin() + iWrite);
+         return (int32_t) t;
+      }
+
+      std::vector<uint8_t> frame_;
+      std::vector<int> slots_; // entry read in each slot of the frame
+      std::vector<int> owner_; // entry whose conversion each slot returns
+      std::vector<int> latency_; // 1 if that conversion started in the previous frame
+      int64_t end_[nAdc];
+      int32_t frameClocks_ = 0;
+      int32_t idle_ = 0;
+   };
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Named shared-memory ring of decoded sample blocks for live viewers.
+//
+// The producer never waits for readers. Each slot carries a sequence number:
+// odd while the producer rewrites it, 2*n+2 once block n is complete. A reader
+// wanting block n checks the sequence before and after using the slot in place;
+// if it changed, the block was overwritten and counts as lost for that reader.
+
+#ifndef OSCI_SHMRING_HPP
+#define OSCI_SHMRING_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <osci/postprocess.hpp>
+
+namespace Osci{
+   const uint32_t ringMagic = 0x4F534352; // "OSCR"
+   const uint32_t ringBlockFrames = 1024;  // frames per published block
+   const uint32_t ringSlots = 256;          // blocks kept in the ring
+
+   struct RingHeader{
+      std::atomic<uint32_t> magic;
+      uint32_t channels;
+      uint32_t blockFrames;
+      uint32_t slots;
+      std::atomic<uint64_t> head; // number of blocks published so far
+   };
+
+   struct RingSlot{
+      std::atomic<uint64_t> seq; // 2*n+1 while writing block n, 2*n+2 when done
+      uint64_t firstFrame;       // index of the first frame in the capture
+      uint32_t frames;           // valid frames, blockFrames except for the last block
+      uint32_t pad;
+      // followed by blockFrames*channels uint16_t samples, interleaved
+   };
+
+   inline size_t ringSlotBytes(uint32_t channels, uint32_t blockFrames){
+      size_t b = sizeof(RingSlot) + (size_t)blockFrames*channels*sizeof(uint16_t);
+      return (b + 63) & ~(size_t)63; // keep slots on separate cache lines
+   }
+
+   inline size_t ringBytes(uint32_t channels, uint32_t blockFrames, uint32_t slots){
+      return 64 + (size_t)slots*ringSlotBytes(channels, blockFrames);
+   }
+
+   inline RingSlot* ringSlot(void* base, const RingHeader* hdr, uint64_t n){
+      return (RingSlot*) ((uint8_t*) base + 64 + (n % hdr->slots)*ringSlotBytes(hdr->channels, hdr->blockFrames));
+   }
+
+   inline uint16_t* slotSamples(RingSlot* slot){
+      return (uint16_t*) (slot + 1);
+   }
+
+   // Producer side: creates (or recreates) the named ring and removes it on destruction.
+   class RingWriter{
+   public:
+      RingWriter(const char* name, uint32_t channels = nAdc, uint32_t blockFrames = ringBlockFrames, uint32_t slots = ringSlots)
+         : name_(name){
+         namespace bip = boost::interprocess;
+         bip::shared_memory_object::remove(name);
+         shm_ = bip::shared_memory_object(bip::create_only, name, bip::read_write);
+         shm_.truncate(ringBytes(channels, blockFrames, slots));
+         region_ = bip::mapped_region(shm_, bip::read_write);
+         hdr_ = new (region_.get_address()) RingHeader;
+         hdr_->channels = channels;
+         hdr_->blockFrames = blockFrames;
+         hdr_->slots = slots;
+         hdr_->head.store(0, std::memory_order_relaxed);
+         for(uint32_t s = 0; s < slots; s++){
+            new (ringSlot(region_.get_address(), hdr_, s)) RingSlot;
+         }
+         hdr_->magic.store(ringMagic, std::memory_order_release); // readers wait for the magic before attaching
+      }
+
+      ~RingWriter(){
+         boost::interprocess::shared_memory_object::remove(name_.c_str());
+      }
+
+      // Publish nFrames decoded frames (channels samples each), split in blocks
+      void publish(const uint16_t* samples, int32_t nFrames){
+         int32_t f = 0;
+         while(f < nFrames){
+            int32_t n = nFrames - f;
+            if(n > (int32_t) hdr_->blockFrames) n = hdr_->blockFrames;
+            uint64_t blk = hdr_->head.load(std::memory_order_relaxed);
+            RingSlot* slot = ringSlot(region_.get_address(), hdr_, blk);
+            slot->seq.store(2*blk+1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot->firstFrame = frames_;
+            slot->frames = n;
+            memcpy(slotSamples(slot), samples + (size_t)f*hdr_->channels, (size_t)n*hdr_->channels*sizeof(uint16_t));
+            slot->seq.store(2*blk+2, std::memory_order_release);
+            hdr_->head.store(blk+1, std::memory_order_release);
+            f += n;
+            frames_ += n;
+         }
+      }
+
+   private:
+      std::string name_;
+      boost::interprocess::shared_memory_object shm_;
+      boost::interprocess::mapped_region region_;
+      RingHeader* hdr_;
+      uint64_t frames_ = 0;
+   };
+
+   // Reader side: attaches read-only, any number of readers may attach.
+   class RingReader{
+   public:
+      explicit RingReader(const char* name){
+         namespace bip = boost::interprocess;
+         shm_ = bip::shared_memory_object(bip::open_only, name, bip::read_only);
+         region_ = bip::mapped_region(shm_, bip::read_only);
+         hdr_ = (const RingHeader*) region_.get_address();
+      }
+
+      bool ready() const{ return hdr_->magic.load(std::memory_order_acquire) == ringMagic; }
+      uint32_t channels() const{ return hdr_->channels; }
+      uint32_t slots() const{ return hdr_->slots; }
+      uint64_t head() const{ return hdr_->head.load(std::memory_order_acquire); }
+
+      // Block n in place, or NULL if it is not published yet or already overwritten.
+      // Use the samples, then confirm with valid(n, slot) that they were not overwritten meanwhile.
+      const RingSlot* acquire(uint64_t n) const{
+         RingSlot* slot = ringSlot(region_.get_address(), hdr_, n);
+         if(slot->seq.load(std::memory_order_acquire) != 2*n+2){
+            return NULL;
+         }
+         return slot;
+      }
+
+      bool valid(uint64_t n, const RingSlot* slot) const{
+         std::atomic_thread_fence(std::memory_order_acquire);
+         return slot->seq.load(std::memory_order_relaxed) == 2*n+2;
+      }
+
+      static const uint16_t* samples(const RingSlot* slot){
+         return (const uint16_t*) (slot + 1);
+      }
+
+   private:
+      boost::interprocess::shared_memory_object shm_;
+      boost::interprocess::mapped_region region_;
+      const RingHeader* hdr_;
+   };
+}
+
+#endif
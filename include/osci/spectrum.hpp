@@ -0,0 +1,282 @@
+// Dynamic performance of the ADC channels from their spectrum (IEEE 1241 style).
+// Each channel is cut into blocks of n samples as it streams in; every block is
+// Blackman-Harris windowed and transformed, and the power spectra are averaged.
+// The report finds the tone(s), refines their frequency from the main lobe (and
+// flags coherent sampling: a whole number of cycles per block), and splits the
+// rest of the spectrum into harmonics, spurs and noise:
+//
+//    SINAD = signal / (noise + distortion)    SNR  = signal / noise
+//    THD   = harmonics / signal (dBc)         SFDR = signal peak / largest spur (dBc)
+//    ENOB  = (SINAD - 1.76 dB) / 6.02 dB
+//
+// With several input tones (e.g. gen.m's two-tone stimulus) the strongest ones
+// are all counted as signal and their harmonics as distortion.
+
+#ifndef OSCI_SPECTRUM_HPP
+#define OSCI_SPECTRUM_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#include <ostream>
+#include <vector>
+#include <osci/decimate.hpp>
+
+namespace Osci{
+   const int analyzerHarmonics = 6; // harmonics 2..6 counted as distortion
+   const int windowLobeBins = 4;    // main lobe half-width of the 4-term Blackman-Harris window
+
+   // In-place radix-2 complex FFT of a fixed power-of-two size
+   class Fft{
+   public:
+      explicit Fft(int n) : n_(n), rev_(n), twiddle_(n/2){
+         int bits = 0;
+         while((1 << bits) < n) bits++;
+         for(int i = 0; i < n; i++){
+            int r = 0;
+            for(int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+            rev_[i] = r;
+         }
+         for(int k = 0; k < n/2; k++) twiddle_[k] = std::polar(1.0, -2*M_PI*k/n);
+      }
+
+      // Forward transform (inverse: conjugate in and out, divide by n)
+      void forward(std::complex<double>* x) const{
+         for(int i = 0; i < n_; i++){
+            if(i < rev_[i]) std::swap(x[i], x[rev_[i]]);
+         }
+         for(int len = 2; len <= n_; len <<= 1){
+            int step = n_/len;
+            for(int i = 0; i < n_; i += len){
+               for(int k = 0; k < len/2; k++){
+                  std::complex<double> t = twiddle_[k*step]*x[i + k + len/2];
+                  x[i + k + len/2] = x[i + k] - t;
+                  x[i + k] += t;
+               }
+            }
+         }
+      }
+
+      int size() const{ return n_; }
+
+      static bool validSize(int n){ return n >= 64 && (n & (n - 1)) == 0; }
+
+   private:
+      int n_;
+      std::vector<int> rev_;
+      std::vector<std::complex<double>> twiddle_;
+   };
+
+   struct DynamicMetrics{
+      double freq = 0;      // strongest tone, cycles per sample (times fs for Hz)
+      bool coherent = false; // whole number of cycles per block
+      double amplitude = 0; // strongest tone, peak, ADC codes
+      double snr = 0, sinad = 0, thd = 0, sfdr = 0; // dB, THD and SFDR in dBc
+      double enob = 0;      // bits
+      uint64_t blocks = 0;  // spectra averaged
+   };
+
+   // One channel: feed samples as they come, report() whenever wanted
+   class DynamicAnalyzer{
+   public:
+      DynamicAnalyzer(const Fft* fft, int tones = 1)
+         : fft_(fft), tones_(tones), window_(fft->size()), block_(fft->size()), power_(fft->size()/2 + 1, 0.0){
+         int n = fft->size();
+         double s2 = 0;
+         for(int i = 0; i < n; i++){
+            double a = 2*M_PI*i/n;
+            window_[i] = 0.35875 - 0.48829*cos(a) + 0.14128*cos(2*a) - 0.01168*cos(3*a);
+            s2 += window_[i]*window_[i];
+         }
+         // One-sided power such that a sine's main lobe sums to its mean power A^2/2
+         scale_ = 2.0/(n*s2);
+      }
+
+      void push(double x){
+         block_[fill_++] = x;
+         if(fill_ == fft_->size()){
+            transform();
+            fill_ = 0;
+         }
+      }
+
+      DynamicMetrics report() const{
+         DynamicMetrics m;
+         m.blocks = blocks_;
+         int half = (int) power_.size() - 1;
+         if(blocks_ == 0) return m;
+
+         // Bins: 0 noise, 1 DC, 2 tone, 3 harmonic
+         std::vector<uint8_t> kind(power_.size(), 0);
+         mark(&kind, 0.0, 1);
+         std::vector<double> freqs;
+         for(int t = 0; t < tones_; t++){
+            int peak = -1;
+            for(int k = 1; k < half; k++){
+               if(kind[k] == 0 && (peak < 0 || power_[k] > power_[peak])) peak = k;
+            }
+            if(peak < 0) break;
+            // Power-weighted centroid of the main lobe
+            double sw = 0, swk = 0;
+            for(int k = peak - windowLobeBins + 1; k < peak + windowLobeBins; k++){
+               if(k < 0 || k > half) continue;
+               sw += power_[k];
+               swk += power_[k]*k;
+            }
+            double f = sw > 0 ? swk/sw : peak;
+            freqs.push_back(f);
+            mark(&kind, f, 2);
+         }
+         if(freqs.empty()) return m;
+         for(double f : freqs){
+            for(int h = 2; h <= analyzerHarmonics; h++){
+               double fh = fmod(h*f, 2.0*half); // alias into the first Nyquist zone
+               if(fh > half) fh = 2.0*half - fh;
+               mark(&kind, fh, 3);
+            }
+         }
+
+         double signal = 0, harmonics = 0, noise = 0, spur = 0;
+         for(int k = 0; k <= half; k++){
+            switch(kind[k]){
+            case 2: signal += power_[k]; break;
+            case 3: harmonics += power_[k]; break;
+            case 0: noise += power_[k]; break;
+            }
+            if(kind[k] != 1 && kind[k] != 2 && power_[k] > spur) spur = power_[k];
+         }
+         // Noise density times the bins taken by the harmonic lobes goes back to the noise
+         int noiseBins = 0;
+         for(int k = 0; k <= half; k++) noiseBins += kind[k] == 0;
+         double perBin = noiseBins > 0 ? noise/noiseBins : 0;
+         for(int k = 0; k <= half; k++){
+            if(kind[k] == 3){
+               harmonics -= perBin;
+               noise += perBin;
+            }
+         }
+         if(harmonics < 0) harmonics = 0;
+
+         int f0 = (int) floor(freqs[0] + 0.5);
+         double lobe0 = 0, peak0 = 0;
+         for(int k = f0 - windowLobeBins; k <= f0 + windowLobeBins; k++){
+            if(k >= 0 && k <= half && kind[k] == 2){
+               lobe0 += power_[k];
+               if(power_[k] > peak0) peak0 = power_[k];
+            }
+         }
+         m.freq = freqs[0]/fft_->size();
+         m.coherent = fabs(freqs[0] - f0) < 0.05;
+         m.amplitude = sqrt(2*lobe0);
+         m.snr = db(signal, noise);
+         m.sinad = db(signal, noise + harmonics);
+         m.thd = db(harmonics, lobe0);
+         m.sfdr = db(peak0, spur);
+         m.enob = (m.sinad - 1.76)/6.02;
+         return m;
+      }
+
+      uint64_t blocks() const{ return blocks_; }
+      // Averaged one-sided power per bin, ADC codes squared
+      const std::vector<double>& power() const{ return power_; }
+
+      void reset(){
+         fill_ = 0;
+         blocks_ = 0;
+         for(double& p : power_) p = 0;
+      }
+
+   private:
+      void transform(){
+         int n = fft_->size();
+         // DC removed first so its window leakage stays out of the low bins
+         double mean = 0;
+         for(int i = 0; i < n; i++) mean += block_[i];
+         mean /= n;
+         buf_.resize(n);
+         for(int i = 0; i < n; i++) buf_[i] = (block_[i] - mean)*window_[i];
+         fft_->forward(buf_.data());
+         // Running mean of the power spectra
+         blocks_++;
+         for(size_t k = 0; k < power_.size(); k++){
+            double p = std::norm(buf_[k])*scale_*(k == 0 || (int) k == n/2 ? 0.5 : 1.0);
+            power_[k] += (p - power_[k])/blocks_;
+         }
+      }
+
+      // Claim the still unclaimed bins of the main lobe centred at f
+      void mark(std::vector<uint8_t>* kind, double f, uint8_t what) const{
+         int half = (int) power_.size() - 1;
+         for(int k = (int) ceil(f - windowLobeBins); k <= (int) floor(f + windowLobeBins); k++){
+            if(k >= 0 && k <= half && (*kind)[k] == 0) (*kind)[k] = what;
+         }
+      }
+
+      static double db(double num, double den){
+         return den > 0 && num > 0 ? 10*log10(num/den) : 0;
+      }
+
+      const Fft* fft_;
+      int tones_;
+      std::vector<double> window_, block_, power_;
+      std::vector<std::complex<double>> buf_;
+      double scale_;
+      int fill_ = 0;
+      uint64_t blocks_ = 0;
+   };
+
+   // One analyzer per column of interleaved frames, sharing the transform
+   class ChannelAnalyzers{
+   public:
+      ChannelAnalyzers(int columns, int n, int tones = 1) : fft_(n){
+         for(int c = 0; c < columns; c++) an_.emplace_back(&fft_, tones);
+      }
+
+      // The analyzers point to fft_
+      ChannelAnalyzers(const ChannelAnalyzers&) = delete;
+      ChannelAnalyzers& operator=(const ChannelAnalyzers&) = delete;
+
+      // Feed nFrames frames of channels() ADC codes
+      void process(const uint16_t* adc, int32_t nFrames){
+         int nc = channels();
+         for(int32_t f = 0; f < nFrames; f++){
+            for(int c = 0; c < nc; c++){
+               an_[c].push(adcSigned(adc[(size_t)f*nc + c]));
+            }
+         }
+      }
+
+      int channels() const{ return (int) an_.size(); }
+      DynamicMetrics report(int c) const{ return an_[c].report(); }
+      // Spectra averaged so far, the same for every column
+      uint64_t blocks() const{ return an_.empty() ? 0 : an_[0].blocks(); }
+
+      // RMS magnitude per bin (ADC codes) of column c's averaged spectrum, bins 0..n/2
+      void magnitudes(int c, std::vector<float>* mag) const{
+         const std::vector<double>& p = an_[c].power();
+         mag->resize(p.size());
+         for(size_t k = 0; k < p.size(); k++) (*mag)[k] = (float) sqrt(p[k]);
+      }
+
+      // One line per column; fs is the per-column sample rate in Hz
+      void print(std::ostream& out, double fs) const{
+         for(int c = 0; c < channels(); c++){
+            DynamicMetrics m = report(c);
+            if(m.blocks == 0){
+               out << "column " << c << ": less than one block of " << fft_.size() << " samples\n";
+               continue;
+            }
+            out << "column " << c << ": " << m.freq*fs << " Hz" << (m.coherent ? " (coherent)" : "")
+                << ", " << codeToVolt(m.amplitude) - codeToVolt(0) << " V peak, SNR " << m.snr << " dB, SINAD " << m.sinad
+                << " dB, THD " << m.thd << " dBc, SFDR " << m.sfdr << " dBc, ENOB " << m.enob
+                << " bits over " << m.blocks << " blocks\n";
+         }
+      }
+
+   private:
+      Fft fft_;
+      std::vector<DynamicAnalyzer> an_;
+   };
+}
+
+#endif
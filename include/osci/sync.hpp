@@ -0,0 +1,116 @@
+// In-stream sync markers. Every syncBlockFrames frames the command stream
+// releases the chip selects and reads the low pins back twice (GET_BITS_LOW):
+// with all CS high and SK idle both bytes match a known pattern. The decoder
+// checks the marker after each block and compacts the good frames in place; on
+// a mismatch (a byte lost or duplicated on the way) it drops the block, scans
+// for the next marker confirmed by the one after it, and counts the frames lost.
+
+#ifndef OSCI_SYNC_HPP
+#define OSCI_SYNC_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <libftdi/ftdi.h>
+#include <osci/board.hpp>
+
+namespace Osci{
+   const int32_t syncBlockFrames = 256;
+   const int32_t syncMarkerBytes = 2;
+   const int32_t syncCmdBytes = releaseCmdBytes + syncMarkerBytes;
+   const uint8_t syncMask = Ft232::pins::SK|Ft232::pins::CS0|Ft232::pins::CS1|Ft232::pins::CS2|Ft232::pins::CS3;
+   const uint8_t syncPattern = Ft232::pinInitialState; // SK low, all CS high
+
+   // Release the chips and read the pins back as a marker
+   inline void appendSync(uint8_t* buf, int32_t* iWrite, int32_t* iRead){
+      releaseCs(buf, iWrite);
+      buf[(*iWrite)++] = GET_BITS_LOW; // opcode: read low bits (ADBUS[0-7])
+      buf[(*iWrite)++] = GET_BITS_LOW;
+      (*iRead) += syncMarkerBytes;
+   }
+
+   inline bool isSyncMarker(const uint8_t* p){
+      return (p[0] & syncMask) == syncPattern && (p[1] & syncMask) == syncPattern;
+   }
+
+   struct SyncStats{
+      int64_t blocks = 0;        // blocks with a good marker
+      int64_t resyncs = 0;       // marker mismatches
+      int64_t droppedFrames = 0; // frames discarded while resynchronizing
+   };
+
+   // Incremental decoder over a raw read buffer: blocks of frameBytes-byte frames
+   // followed by a marker, the last block possibly shorter.
+   class SyncStream{
+   public:
+      SyncStream(int32_t frameBytes, int32_t blockFrames = syncBlockFrames)
+         : frameBytes_(frameBytes), blockBytes_(blockFrames*frameBytes), blockFrames_(blockFrames){}
+
+      // buf holds avail raw bytes (more may arrive later unless final). Good frames
+      // are moved to the front of buf; returns the number of bytes of good frames.
+      int32_t process(uint8_t* buf, int32_t avail, bool final){
+         while(true){
+            int32_t left = avail - in_;
+            if(left >= blockBytes_ + syncMarkerBytes){
+               if(isSyncMarker(buf + in_ + blockBytes_)){
+                  keep(buf, blockBytes_);
+                  continue;
+               }
+            }else if(final){
+               if(left >= syncMarkerBytes && (left - syncMarkerBytes) % frameBytes_ == 0
+                  && isSyncMarker(buf + avail - syncMarkerBytes)){
+                  keep(buf, left - syncMarkerBytes);
+               }else if(left > 0){
+                  drop(left);
+               }
+               return out_;
+            }else{
+               return out_; // wait for the rest of the block
+            }
+
+            // Mismatch: the next marker is the one followed by another a block later
+            int32_t q = in_;
+            for(; q + syncMarkerBytes <= avail; q++){
+               if(!isSyncMarker(buf + q)) continue;
+               int32_t next = q + syncMarkerBytes + blockBytes_;
+               if(next + syncMarkerBytes <= avail){
+                  if(isSyncMarker(buf + next)) break;
+               }else if(final){
+                  break; // nothing left to confirm it with
+               }else{
+                  return out_; // wait for the next block
+               }
+            }
+            if(q + syncMarkerBytes > avail){
+               if(!final) return out_;
+               drop(avail - in_);
+               return out_;
+            }
+            stats.resyncs++;
+            drop(q + syncMarkerBytes - in_);
+         }
+      }
+
+      SyncStats stats;
+
+   private:
+      void keep(uint8_t* buf, int32_t bytes){
+         memmove(buf + out_, buf + in_, bytes);
+         out_ += bytes;
+         in_ += bytes + syncMarkerBytes;
+         stats.blocks++;
+      }
+
+      // Skip raw bytes, counted as whole blocks when they span about one or more
+      void drop(int32_t bytes){
+         int32_t span = blockBytes_ + syncMarkerBytes;
+         int64_t blocks = (bytes + span/2)/span;
+         stats.droppedFrames += blocks > 0 ? blocks*blockFrames_ : (bytes + frameBytes_ - 1)/frameBytes_;
+         in_ += bytes;
+      }
+
+      int32_t frameBytes_, blockBytes_, blockFrames_;
+      int32_t in_ = 0, out_ = 0;
+   };
+}
+
+#endif
@@ -0,0 +1,76 @@
+// Host time base for sample blocks. The completion time of each USB transfer is
+// stamped with the number of frames received so far, and a running linear fit
+// maps the frame index to host time: the slope is the real frame period, its
+// deviation from the nominal one the clock drift, and the residual the transfer
+// jitter. Times are steady_clock, converted to wall-clock time through an offset
+// taken once at start, so captures can be lined up with other instruments' logs.
+
+#ifndef OSCI_TIMEBASE_HPP
+#define OSCI_TIMEBASE_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+namespace Osci{
+   struct TimeStamp{
+      uint64_t frame; // frames received when the transfer completed
+      int64_t ns;     // wall-clock time, ns since the epoch
+   };
+
+   class TimeBase{
+   public:
+      TimeBase(){
+         int64_t steady = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+         int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+         wallOffset_ = wall - steady;
+         base_ = steady;
+      }
+
+      // Record a transfer completion after frames frames
+      void mark(uint64_t frames){
+         int64_t steady = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+         stamps.push_back({frames, steady + wallOffset_});
+
+         // Online least squares (Welford), times relative to the start to keep precision
+         double x = (double) frames, y = (double) (steady - base_);
+         n_++;
+         double dx = x - meanX_;
+         meanX_ += dx/n_;
+         double dy = y - meanY_;
+         meanY_ += dy/n_;
+         cxx_ += dx*(x - meanX_);
+         cxy_ += dx*(y - meanY_);
+         cyy_ += dy*(y - meanY_);
+      }
+
+      uint64_t count() const{ return n_; }
+      // Fitted frame period in ns, 0 until two transfers with different frame counts
+      double nsPerFrame() const{ return cxx_ > 0 ? cxy_/cxx_ : 0; }
+      // Fitted wall-clock time of frame 0, ns since the epoch
+      int64_t startNs() const{ return base_ + wallOffset_ + (int64_t) (meanY_ - nsPerFrame()*meanX_); }
+      // Deviation of the fitted period from the nominal one, in ppm
+      double driftPpm(double nominalNsPerFrame) const{
+         return nominalNsPerFrame > 0 ? (nsPerFrame()/nominalNsPerFrame - 1.0)*1e6 : 0;
+      }
+      // RMS residual of the transfer times around the fit, in ns
+      double jitterNs() const{
+         if(n_ < 3 || cxx_ <= 0) return 0;
+         double rss = cyy_ - cxy_*cxy_/cxx_;
+         return rss > 0 ? sqrt(rss/(n_ - 2)) : 0;
+      }
+
+      std::vector<TimeStamp> stamps;
+
+   private:
+      int64_t wallOffset_, base_;
+      uint64_t n_ = 0;
+      double meanX_ = 0, meanY_ = 0, cxx_ = 0, cxy_ = 0, cyy_ = 0;
+   };
+}
+
+#endif
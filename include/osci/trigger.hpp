@@ -0,0 +1,51 @@
+// Edge trigger on one column of interleaved frames. It fires on the frame where
+// the column reaches the level in the chosen direction and re-arms once it has
+// come back past the level by the hysteresis, so noise around the level fires
+// once per crossing. A column already past the level at the start doesn't fire.
+
+#ifndef OSCI_TRIGGER_HPP
+#define OSCI_TRIGGER_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <osci/decimate.hpp>
+
+namespace Osci{
+   const int32_t triggerHysteresis = 8; // ADC codes
+
+   // Volts to the nearest signed ADC code, inverse of codeToVolt
+   inline int32_t voltToCode(double volt){
+      return (int32_t) floor((volt + 2.5)/5.0*4095.0 - 2048.0 + 0.5);
+   }
+
+   class EdgeTrigger{
+   public:
+      // level in signed ADC codes
+      EdgeTrigger(int column, int32_t level, bool rising = true, int32_t hysteresis = triggerHysteresis)
+         : column_(column), sign_(rising ? 1 : -1), level_(rising ? level : -level), hysteresis_(hysteresis){}
+
+      // Feed nFrames frames of columns ADC codes, the first being frame first of the
+      // stream; appends the frames the trigger fires on to events
+      void process(const uint16_t* adc, int32_t nFrames, int columns, uint64_t first, std::vector<uint64_t>* events){
+         for(int32_t f = 0; f < nFrames; f++){
+            int32_t x = sign_*adcSigned(adc[(size_t)f*columns + column_]);
+            if(armed_ && x >= level_){
+               events->push_back(first + f);
+               armed_ = false;
+            }else if(!armed_ && x < level_ - hysteresis_){
+               armed_ = true;
+            }
+         }
+      }
+
+      int column() const{ return column_; }
+
+   private:
+      int column_, sign_;
+      int32_t level_, hysteresis_;
+      bool armed_ = false;
+   };
+}
+
+#endif
@@ -0,0 +1,256 @@
+// Asynchronous bulk transfers on an asio io_context. Reads and writes go through
+// libftdi's submit calls (so the write queue depth and the modem status stripping
+// apply) and complete from libusb events: on POSIX the io_context watches the
+// libusb file descriptors itself, so no extra thread is needed; where libusb has
+// no pollable descriptors (Windows) one thread per device handles the events.
+// Either way the completion handler runs on its associated executor, so with
+// use_awaitable acquisition, processing and network output can be straight-line
+// coroutines on one event loop:
+//
+//    boost::asio::co_spawn(io, [&]() -> boost::asio::awaitable<void>{
+//       co_await usb.write(cmd, nCmd);
+//       int n = co_await usb.read(buf, nRead);
+//       ...
+//    }, boost::asio::detached);
+//
+// Needs the libusb headers (-I/usr/include/libusb-1.0 or pkg-config), and C++20
+// (-std=c++20 -fcoroutines) for read()/write(); asyncRead()/asyncWrite() take any
+// completion token. Construct after the device is opened. Keep at most one read
+// and one write in flight per device, and their buffers valid until completion;
+// cancel() ends both, e.g. when one has failed and the other waits on a stalled chip.
+
+#ifndef OSCI_USBASYNC_HPP
+#define OSCI_USBASYNC_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <libusb.h>
+#include <libftdi/ftdi.h>
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+#include <poll.h>
+#endif
+
+namespace Osci{
+   class UsbAsync{
+   public:
+      UsbAsync(boost::asio::io_context& io, struct ftdi_context* ftdi) : io_(io), ftdi_(ftdi), timer_(io){
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+         const struct libusb_pollfd** fds = libusb_get_pollfds(ftdi->usb_ctx);
+         if(fds){
+            for(int i = 0; fds[i]; i++){
+               watches_.push_back(std::make_shared<Watch>(io, fds[i]->fd, fds[i]->events));
+            }
+            libusb_free_pollfds(fds);
+         }
+#endif
+         if(!watching()){
+            running_ = true;
+            pump_ = std::thread([this]{
+               while(running_){
+                  struct timeval tv = {0, 100000};
+                  libusb_handle_events_timeout_completed(ftdi_->usb_ctx, &tv, NULL);
+                  finish();
+               }
+            });
+         }
+      }
+
+      // Pending transfers are cancelled, their handlers never run
+      ~UsbAsync(){
+         if(pump_.joinable()){
+            running_ = false;
+            libusb_interrupt_event_handler(ftdi_->usb_ctx);
+            pump_.join();
+         }
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+         for(auto& w : watches_){
+            boost::system::error_code ec;
+            w->fd.cancel(ec);
+            w->fd.release(); // owned by libusb
+         }
+#endif
+         for(auto& op : pending_) ftdi_transfer_data_cancel(op.tc, NULL);
+      }
+
+      UsbAsync(const UsbAsync&) = delete;
+      UsbAsync& operator=(const UsbAsync&) = delete;
+
+      // Completion signature void(int): bytes transferred or < 0 on error
+      template<typename Token>
+      auto asyncRead(uint8_t* buf, int size, Token&& token){
+         return boost::asio::async_initiate<Token, void(int)>([this, buf, size](auto handler){
+            start([this, buf, size]{ return ftdi_read_data_submit(ftdi_, buf, size); }, std::move(handler));
+         }, token);
+      }
+
+      template<typename Token>
+      auto asyncWrite(const uint8_t* buf, int size, Token&& token){
+         return boost::asio::async_initiate<Token, void(int)>([this, buf, size](auto handler){
+            start([this, buf, size]{ return ftdi_write_data_submit(ftdi_, (uint8_t*) buf, size); }, std::move(handler));
+         }, token);
+      }
+
+      // Cancel the transfers in flight, their handlers get -1
+      void cancel(){
+         std::vector<std::function<void(int)>> cancelled;
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(auto& op : pending_){
+               ftdi_transfer_data_cancel(op.tc, NULL);
+               cancelled.push_back(std::move(op.complete));
+            }
+            pending_.clear();
+         }
+         for(auto& complete : cancelled) complete(-1);
+         arm();
+      }
+
+#ifdef BOOST_ASIO_HAS_CO_AWAIT
+      boost::asio::awaitable<int> read(uint8_t* buf, int size){
+         co_return co_await asyncRead(buf, size, boost::asio::use_awaitable);
+      }
+
+      boost::asio::awaitable<int> write(const uint8_t* buf, int size){
+         co_return co_await asyncWrite(buf, size, boost::asio::use_awaitable);
+      }
+#endif
+
+   private:
+      struct Op{
+         struct ftdi_transfer_control* tc;
+         std::function<void(int)> complete;
+      };
+
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+      struct Watch{
+         Watch(boost::asio::io_context& io, int native, short events)
+            : fd(io, native), wait(events & POLLOUT ? boost::asio::posix::stream_descriptor::wait_write
+                                                    : boost::asio::posix::stream_descriptor::wait_read){}
+         boost::asio::posix::stream_descriptor fd;
+         boost::asio::posix::stream_descriptor::wait_type wait;
+         bool armed = false;
+         unsigned gen = 0; // bumped on cancel, so a stale completion can't disarm a new wait
+      };
+#endif
+
+      // Submit under the lock: the context's transfer pool is shared with finish().
+      // The transfer control is only looked at again by finish(), on the thread that
+      // handles the libusb events and so writes it, even when a read was served from
+      // the read buffer and is complete already.
+      template<typename Submit, typename Handler>
+      void start(Submit submit, Handler handler){
+         auto ex = boost::asio::get_associated_executor(handler, io_.get_executor());
+         struct State{
+            Handler handler;
+            boost::asio::executor_work_guard<decltype(ex)> work;
+         };
+         auto state = std::make_shared<State>(State{std::move(handler), boost::asio::make_work_guard(ex)});
+         Op op;
+         op.complete = [ex, state](int n){
+            boost::asio::post(ex, [state, n]{
+               std::move(state->handler)(n);
+            });
+         };
+
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            op.tc = submit();
+            if(op.tc) pending_.push_back(std::move(op));
+         }
+         if(!op.tc) op.complete(-1);
+         else if(watching()) poll();
+         else libusb_interrupt_event_handler(ftdi_->usb_ctx); // wake pump_ for finish()
+      }
+
+      bool watching() const{
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+         return !watches_.empty();
+#else
+         return false;
+#endif
+      }
+
+      // Hand finished transfers to their handlers
+      void finish(){
+         std::vector<std::pair<std::function<void(int)>, int>> done;
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(auto it = pending_.begin(); it != pending_.end();){
+               if(it->tc->completed){
+                  done.emplace_back(std::move(it->complete), ftdi_transfer_data_done(it->tc));
+                  it = pending_.erase(it);
+               }else{
+                  ++it;
+               }
+            }
+         }
+         for(auto& d : done) d.first(d.second);
+      }
+
+      // Handle whatever libusb has ready, then wait again while transfers are pending
+      void poll(){
+         struct timeval zero = {0, 0};
+         libusb_handle_events_timeout_completed(ftdi_->usb_ctx, &zero, NULL);
+         finish();
+         arm();
+      }
+
+      void arm(){
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+         if(!watching()) return;
+         if(pending_.empty()){
+            // Nothing to wait for: don't keep io_context::run() busy
+            for(auto& w : watches_){
+               boost::system::error_code ec;
+               w->fd.cancel(ec);
+               w->armed = false;
+               w->gen++;
+            }
+            timer_.cancel();
+            return;
+         }
+         for(auto& w : watches_){
+            if(w->armed) continue;
+            w->armed = true;
+            // The watch outlives a cancelled wait; this is only used when not cancelled
+            std::shared_ptr<Watch> pw = w;
+            unsigned gen = w->gen;
+            w->fd.async_wait(w->wait, [this, pw, gen](boost::system::error_code ec){
+               if(ec || pw->gen != gen) return;
+               pw->armed = false;
+               poll();
+            });
+         }
+         // Older libusb without timerfd needs its timeouts driven from outside
+         struct timeval tv;
+         if(!libusb_pollfds_handle_timeouts(ftdi_->usb_ctx) && libusb_get_next_timeout(ftdi_->usb_ctx, &tv) == 1){
+            timer_.expires_after(std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec));
+            timer_.async_wait([this](boost::system::error_code ec){
+               if(!ec) poll();
+            });
+         }
+#endif
+      }
+
+      boost::asio::io_context& io_;
+      struct ftdi_context* ftdi_;
+      boost::asio::steady_timer timer_;
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+      std::vector<std::shared_ptr<Watch>> watches_;
+#endif
+      std::list<Op> pending_;
+      std::mutex mutex_; // pending_ is shared with pump_
+      std::atomic<bool> running_{false};
+      std::thread pump_;
+   };
+}
+
+#endif
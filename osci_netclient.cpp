@@ -0,0 +1,75 @@
+// Client for ftdi_readWrite --serve <port>: writes received sample blocks to csv,
+// prints trigger events and spectrum peaks and reports messages dropped by the
+// server for being slow.
+//g++ osci_netclient.cpp -I include/ -O2 -pthread -o build/osci_netclient -Wall
+
+#include <osci/netserver.hpp>
+#include <iostream>
+#include <fstream>
+
+
+int main(int argc, char *argv[]){
+   const char* host = "127.0.0.1";
+   uint16_t port = Osci::netPort;
+   const char* outPath = "net.csv";
+   switch (argc)
+   {
+   case 4:
+      outPath = argv[3];
+   case 3:
+      port = (uint16_t) std::stoi(argv[2]);
+   case 2:
+      host = argv[1];
+      break;
+
+   default:
+      break;
+   }
+
+   boost::asio::io_context io;
+   boost::asio::ip::tcp::socket socket(io);
+   boost::system::error_code ec;
+   socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(host), port), ec);
+   if(ec){
+      std::cout << "Can't connect to " << host << ":" << port << ": " << ec.message() << '\n';
+      exit(1);
+   }
+
+   std::ofstream outFile;
+   outFile.open(outPath);
+   uint64_t expected = 0, dropped = 0;
+   std::vector<uint8_t> payload;
+   while(true){
+      Osci::NetHeader hdr;
+      boost::asio::read(socket, boost::asio::buffer(&hdr, sizeof(hdr)), ec);
+      if(ec) break; // server closed the connection
+      if(!Osci::validHeader(hdr)){
+         std::cout << "Bad message header (type " << hdr.type << ", " << hdr.bytes << " bytes), closing\n";
+         break;
+      }
+      payload.resize(hdr.bytes);
+      boost::asio::read(socket, boost::asio::buffer(payload), ec);
+      if(ec) break;
+      if(expected != 0 && hdr.seq != expected) dropped += hdr.seq - expected;
+      expected = hdr.seq + 1;
+
+      if(hdr.type == Osci::MSG_SAMPLES){
+         const uint16_t* s = (const uint16_t*) payload.data();
+         size_t n = hdr.bytes/sizeof(uint16_t);
+         for(size_t i = 0; i < n; i++){
+            outFile << std::dec << s[i] << ((i+1) % hdr.channel ? "; " : "\n");
+         }
+      }else if(hdr.type == Osci::MSG_TRIGGER){
+         std::cout << "trigger on channel " << hdr.channel << " at frame " << hdr.frame << '\n';
+      }else if(hdr.type == Osci::MSG_SPECTRUM && hdr.bytes > sizeof(float)){
+         const float* m = (const float*) payload.data();
+         size_t n = hdr.bytes/sizeof(float), peak = 1;
+         for(size_t k = 1; k < n; k++) if(m[k] > m[peak]) peak = k;
+         std::cout << "spectrum of channel " << hdr.channel << " at frame " << hdr.frame << ": " << n
+                   << " bins, peak at bin " << peak << " (" << m[peak] << " codes RMS)\n";
+      }
+   }
+   outFile.close();
+   std::cout << "Done, " << dropped << " messages dropped by the server\n";
+   return 0;
+}
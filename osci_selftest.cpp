@@ -0,0 +1,53 @@
+// Checks the MLS correlation of include/osci/mls.hpp without hardware: a known
+// short response is convolved with the sequence, with and without an offset, and
+// must come back as h[k] - sum(h)/L (the offset and the DC gain are taken out).
+// Usage: osci_selftest [--order m]   (default: every order)
+//g++ osci_selftest.cpp -I include/ -O2 -o build/osci_selftest -Wall
+
+#include <osci/mls.hpp>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+int main(int argc, char *argv[]){
+   int first = Osci::mlsMinOrder, last = Osci::mlsMaxOrder;
+   for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], "--order") == 0 && a+1 < argc) first = last = std::stoi(argv[++a]);
+   }
+   if(first < Osci::mlsMinOrder || last > Osci::mlsMaxOrder){
+      std::cout << "The order must be " << Osci::mlsMinOrder << ".." << Osci::mlsMaxOrder << '\n';
+      exit(1);
+   }
+
+   const double taps[4] = {0.5, 0.3, -0.1, 0.05};
+   const double tapSum = 0.75;
+   const double offset = 1000.0;
+   int failed = 0;
+   for(int order = first; order <= last; order++){
+      Osci::Mls mls(order);
+      const int32_t length = mls.length();
+      std::vector<double> y(length), h(length);
+      double worst = 0;
+      for(double off : {0.0, offset}){
+         for(int32_t n = 0; n < length; n++){
+            y[n] = off;
+            for(int32_t j = 0; j < 4; j++) y[n] += taps[j]*mls.level((n - j + length) % length);
+         }
+         mls.impulse(y.data(), h.data());
+         for(int32_t k = 0; k < length; k++){
+            double want = (k < 4 ? taps[k] : 0.0) - tapSum/length;
+            worst = std::max(worst, fabs(h[k] - want));
+         }
+      }
+      bool ok = worst <= 1e-9;
+      failed += !ok;
+      std::cout << "MLS order " << order << ": " << (ok ? "ok" : "FAILED") << ", max error " << worst << '\n';
+   }
+   if(failed > 0){
+      std::cout << failed << " orders failed\n";
+      exit(1);
+   }
+   return 0;
+}
@@ -0,0 +1,65 @@
+// Live viewer for the shared-memory ring published by ftdi_readWrite --shm <name>.
+// Prints the per-channel mean of every block and counts blocks lost to overruns.
+//g++ osci_shmview.cpp -I include/ -O2 -lrt -o build/osci_shmview -Wall
+
+#include <osci/shmring.hpp>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+
+int main(int argc, char *argv[]){
+   const char* name = (argc > 1) ? argv[1] : "osci";
+
+   std::unique_ptr<Osci::RingReader> ring;
+   while(!ring){ // wait for the producer
+      try{
+         ring.reset(new Osci::RingReader(name));
+      }catch(boost::interprocess::interprocess_exception&){
+         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+   }
+   while(!ring->ready()){
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   uint64_t next = ring->head();
+   uint64_t lost = 0;
+   while(true){
+      uint64_t head = ring->head();
+      if(next == head){
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         continue;
+      }
+      const Osci::RingSlot* slot = ring->acquire(next);
+      if(slot != NULL){
+         uint32_t channels = ring->channels();
+         uint32_t frames = slot->frames;
+         uint64_t firstFrame = slot->firstFrame;
+         const uint16_t* s = Osci::RingReader::samples(slot);
+         double mean[Osci::nAdc] = {0};
+         for(uint32_t f = 0; f < frames; f++){
+            for(uint32_t c = 0; c < channels && c < (uint32_t) Osci::nAdc; c++){
+               mean[c] += s[f*channels + c];
+            }
+         }
+         if(ring->valid(next, slot)){
+            std::cout << firstFrame;
+            for(uint32_t c = 0; c < channels && c < (uint32_t) Osci::nAdc; c++){
+               std::cout << "; " << mean[c]/frames;
+            }
+            std::cout << std::endl; // live output, flush every block
+            next++;
+            continue;
+         }
+      }
+      // Overwritten before we got to it: skip to the oldest block still in the ring
+      uint64_t oldest = head > ring->slots() ? head - ring->slots() + 1 : next + 1;
+      if(oldest <= next) oldest = next + 1;
+      lost += oldest - next;
+      next = oldest;
+      std::cout << "lost " << lost << " blocks" << std::endl;
+   }
+   return 0;
+}
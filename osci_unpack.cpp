@@ -0,0 +1,62 @@
+// Converts a packed capture (out.osc, see include/osci/codec.hpp) back to csv.
+//g++ osci_unpack.cpp -I include/ -O3 -mssse3 -o build/osci_unpack -Wall
+
+#include <osci/codec.hpp>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+
+
+int main(int argc, char *argv[]){
+   const char* inPath = "out.osc";
+   const char* outPath = "out.csv";
+   switch (argc)
+   {
+   case 3:
+      outPath = argv[2];
+   case 2:
+      inPath = argv[1];
+      break;
+
+   default:
+      break;
+   }
+
+   Osci::CaptureHeader hdr;
+   Osci::CaptureTiming timing;
+   std::vector<uint16_t> samples;
+   std::vector<Osci::TimeStamp> index;
+   Osci::CaptureStatus status;
+   std::vector<uint64_t> overrunFrames;
+   auto t0 = std::chrono::steady_clock::now();
+   if(!Osci::readCapture(inPath, &hdr, &samples, &timing, &index, &status, &overrunFrames)){
+      std::cout << "Failed to read " << inPath << "\n";
+      exit(1);
+   }
+   double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   std::cout << hdr.frames << " frames, " << (double) samples.size()*sizeof(uint16_t)/(hdr.payloadBytes + sizeof(hdr))
+             << "x compression, decoded at " << samples.size()*sizeof(uint16_t)/secs/1e6 << " MB/s\n";
+   if(hdr.version >= Osci::captureTimedVersion){
+      std::cout << "frame 0 at " << timing.startNs << " ns (epoch), " << timing.nsPerFrame << " ns/frame, drift "
+                << timing.driftPpm << " ppm, jitter " << timing.jitterNs/1000.0 << " us, "
+                << index.size() << " transfer timestamps\n";
+   }
+   if(hdr.version >= Osci::captureStatusVersion){
+      std::cout << status.packets << " USB packets, " << status.overruns << " FIFO overruns, " << status.errors << " line errors";
+      for(size_t i = 0; i < overrunFrames.size(); i++){
+         std::cout << (i == 0 ? ", overrun at frame " : ", ") << overrunFrames[i];
+      }
+      std::cout << '\n';
+   }
+
+   std::ofstream outFile;
+   outFile.open(outPath);
+   for(uint64_t f = 0; f < hdr.frames; f++){
+      for(int c = 0; c < hdr.channels; c++){
+         outFile << std::dec << samples[f*hdr.channels + c] << (c < hdr.channels-1 ? "; " : "\n");
+      }
+   }
+   outFile.close();
+   std::cout << "Done\n";
+   return 0;
+}